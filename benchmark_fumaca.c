@@ -0,0 +1,329 @@
+// =================================================================
+//      BENCHMARK POR ETAPA DO DETECTOR DE FUMAÇA
+// =================================================================
+// Mede cada etapa do detector isoladamente, repetindo-a sobre cada imagem
+// do corpus, e imprime um CSV com megapixels/s, ns/pixel e a variância
+// do ns/pixel entre as repetições.
+//
+// Para compilar (no terminal):
+// gcc -O2 benchmark_fumaca.c -o benchmark -lm -lpthread
+//
+// Para executar:
+// ./benchmark                       (corpus padrão, 10 repetições)
+// ./benchmark -r 50 "fotos/*.jpg" > medidas.csv
+// =================================================================
+
+// O detector é incluído inteiro (sem o main) para medir as mesmas funções
+#define DETECTOR_SEM_MAIN
+#include "detector_fumaca.c"
+
+// Corpus padrão: as imagens de teste do projeto.
+static const char *CORPUS_PADRAO[] = {
+    "extracao-dados/teste_imagens/imagens_teste",
+    "imagem_teste*.jpg",
+};
+
+#define REPETICOES_PADRAO 10
+
+// -----------------------------------------------------------------
+// 1. ETAPAS MEDIDAS
+// -----------------------------------------------------------------
+// Cada etapa recebe as entradas já prontas (calculadas uma vez por imagem),
+// mede só a chamada da função e libera o resultado fora da medição.
+
+typedef struct {
+    const char *caminho;
+    unsigned char *arquivo;     // Conteúdo do arquivo (a decodificação não mede o disco)
+    int tamanho_arquivo;
+    Image rgb;                  // 3 canais
+    Image hsi;
+    Image mascara_rgb;
+    Image mascara_hsi;
+    Image mascara_final;
+    MascaraBits bits_rgb;
+    MascaraBits bits_hsi;
+    MascaraBits bits_final;
+} DadosImagem;
+
+typedef double (*FuncaoEtapa)(DadosImagem *d);
+
+static double etapa_decodificar(DadosImagem *d) {
+    int w, h, c;
+    double t0 = relogio_parede_ns();
+    unsigned char *p = stbi_load_from_memory(d->arquivo, d->tamanho_arquivo, &w, &h, &c, 3);
+    double t = relogio_parede_ns() - t0;
+    stbi_image_free(p);
+    return t;
+}
+
+static double etapa_segmentar_rgb(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    Image m = segmentar_fumaca_rgb(&d->rgb);
+    double t = relogio_parede_ns() - t0;
+    reserva_devolver(m.data);
+    return t;
+}
+
+static double etapa_rgb_para_hsi(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    Image m = rgb_para_hsi(&d->rgb);
+    double t = relogio_parede_ns() - t0;
+    reserva_devolver(m.data);
+    return t;
+}
+
+static double etapa_segmentar_hsi(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    Image m = segmentar_fumaca_hsi(&d->hsi);
+    double t = relogio_parede_ns() - t0;
+    reserva_devolver(m.data);
+    return t;
+}
+
+static double etapa_combinar(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    Image m = combinar_mascaras(&d->mascara_rgb, &d->mascara_hsi);
+    double t = relogio_parede_ns() - t0;
+    reserva_devolver(m.data);
+    return t;
+}
+
+static volatile long contagem_descartada; // Impede que o compilador elimine a contagem
+
+static double etapa_contar(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    contagem_descartada = contar_mascara(&d->mascara_final);
+    return relogio_parede_ns() - t0;
+}
+
+static double etapa_codificar_png(DadosImagem *d) {
+    int tamanho;
+    double t0 = relogio_parede_ns();
+    unsigned char *png = stbi_write_png_to_mem(d->mascara_final.data, d->mascara_final.width,
+                                               d->mascara_final.width, d->mascara_final.height, 1, &tamanho);
+    double t = relogio_parede_ns() - t0;
+    STBIW_FREE(png);
+    return t;
+}
+
+static double etapa_segmentar_rgb_bits(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    MascaraBits m = segmentar_fumaca_rgb_bits(&d->rgb, &LIMIARES_PADRAO);
+    double t = relogio_parede_ns() - t0;
+    mascara_bits_liberar(&m);
+    return t;
+}
+
+static double etapa_segmentar_hsi_bits(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    MascaraBits m = segmentar_fumaca_hsi_bits(&d->rgb, &LIMIARES_PADRAO);
+    double t = relogio_parede_ns() - t0;
+    mascara_bits_liberar(&m);
+    return t;
+}
+
+static double etapa_combinar_bits(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    MascaraBits m = combinar_mascaras_bits(&d->bits_rgb, &d->bits_hsi);
+    double t = relogio_parede_ns() - t0;
+    mascara_bits_liberar(&m);
+    return t;
+}
+
+static double etapa_contar_bits(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    contagem_descartada = contar_mascara_bits(&d->bits_final);
+    return relogio_parede_ns() - t0;
+}
+
+static double etapa_fundido(DadosImagem *d) {
+    double t0 = relogio_parede_ns();
+    contagem_descartada = classificar_fumaca_fundido(&d->rgb, &LIMIARES_PADRAO, NULL);
+    return relogio_parede_ns() - t0;
+}
+
+typedef struct {
+    const char *nome;
+    FuncaoEtapa executar;
+} Etapa;
+
+static const Etapa ETAPAS[] = {
+    {"decodificar", etapa_decodificar},
+    {"segmentar_rgb", etapa_segmentar_rgb},
+    {"rgb_para_hsi", etapa_rgb_para_hsi},
+    {"segmentar_hsi", etapa_segmentar_hsi},
+    {"combinar", etapa_combinar},
+    {"contar", etapa_contar},
+    {"codificar_png", etapa_codificar_png},
+    {"segmentar_rgb_bits", etapa_segmentar_rgb_bits},
+    {"segmentar_hsi_bits", etapa_segmentar_hsi_bits},
+    {"combinar_bits", etapa_combinar_bits},
+    {"contar_bits", etapa_contar_bits},
+    {"fundido", etapa_fundido},
+};
+
+#define NUM_ETAPAS ((int)(sizeof(ETAPAS) / sizeof(ETAPAS[0])))
+
+// -----------------------------------------------------------------
+// 2. PREPARAÇÃO DAS ENTRADAS
+// -----------------------------------------------------------------
+
+static unsigned char *ler_arquivo(const char *caminho, int *tamanho) {
+    FILE *f = fopen(caminho, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *dados = n > 0 ? (unsigned char *)malloc(n) : NULL;
+    if (dados && fread(dados, 1, n, f) != (size_t)n) {
+        free(dados);
+        dados = NULL;
+    }
+    fclose(f);
+    *tamanho = (int)n;
+    return dados;
+}
+
+/**
+ * @brief Lê e decodifica a imagem e calcula as entradas de todas as etapas.
+ */
+static bool preparar_dados(const char *caminho, DadosImagem *d) {
+    memset(d, 0, sizeof(*d));
+    d->caminho = caminho;
+    d->arquivo = ler_arquivo(caminho, &d->tamanho_arquivo);
+    if (!d->arquivo) return false;
+    int c;
+    d->rgb.data = stbi_load_from_memory(d->arquivo, d->tamanho_arquivo, &d->rgb.width, &d->rgb.height, &c, 3);
+    if (!d->rgb.data) {
+        free(d->arquivo);
+        return false;
+    }
+    d->rgb.channels = 3;
+    d->hsi = rgb_para_hsi(&d->rgb);
+    d->mascara_rgb = segmentar_fumaca_rgb(&d->rgb);
+    d->mascara_hsi = segmentar_fumaca_hsi(&d->hsi);
+    d->mascara_final = combinar_mascaras(&d->mascara_rgb, &d->mascara_hsi);
+    d->bits_rgb = segmentar_fumaca_rgb_bits(&d->rgb, &LIMIARES_PADRAO);
+    d->bits_hsi = segmentar_fumaca_hsi_bits(&d->rgb, &LIMIARES_PADRAO);
+    d->bits_final = combinar_mascaras_bits(&d->bits_rgb, &d->bits_hsi);
+    return true;
+}
+
+static void liberar_dados(DadosImagem *d) {
+    free(d->arquivo);
+    stbi_image_free(d->rgb.data);
+    reserva_devolver(d->hsi.data);
+    reserva_devolver(d->mascara_rgb.data);
+    reserva_devolver(d->mascara_hsi.data);
+    reserva_devolver(d->mascara_final.data);
+    mascara_bits_liberar(&d->bits_rgb);
+    mascara_bits_liberar(&d->bits_hsi);
+    mascara_bits_liberar(&d->bits_final);
+}
+
+// -----------------------------------------------------------------
+// 3. ESTATÍSTICAS E SAÍDA CSV
+// -----------------------------------------------------------------
+
+/**
+ * @brief Imprime uma linha do CSV a partir dos tempos (ns) de cada repetição.
+ * A variância (amostral) é a do ns/pixel entre as repetições.
+ */
+static void imprimir_linha(const char *etapa, const char *imagem, long pixels, const double *tempos, int repeticoes) {
+    double media = 0.0, m2 = 0.0;
+    for (int r = 0; r < repeticoes; ++r) { // Welford
+        double ns_pixel = tempos[r] / pixels;
+        double delta = ns_pixel - media;
+        media += delta / (r + 1);
+        m2 += delta * (ns_pixel - media);
+    }
+    double variancia = repeticoes > 1 ? m2 / (repeticoes - 1) : 0.0;
+    printf("%s,%s,%ld,%d,%.3f,%.4f,%.6f\n", etapa, imagem, pixels, repeticoes,
+           1e3 / media, media, variancia);
+}
+
+static void imprimir_uso_benchmark(const char *programa) {
+    fprintf(stderr, "Uso: %s [-r repetições] [--kernel nome] [entrada...]\n", programa);
+    fprintf(stderr, "  entrada    Diretório, padrão glob ou arquivo (padrão: %s e %s)\n",
+            CORPUS_PADRAO[0], CORPUS_PADRAO[1]);
+    fprintf(stderr, "  -r <n>     Repetições medidas por etapa e imagem (padrão: %d)\n", REPETICOES_PADRAO);
+    fprintf(stderr, "  --kernel   Kernel da regra RGB: escalar, sse41 ou avx2\n");
+    fprintf(stderr, "Saída (CSV): etapa,imagem,pixels,repeticoes,mpix_s,ns_pixel,variancia_ns_pixel\n");
+    fprintf(stderr, "A imagem 'TODAS' soma o corpus inteiro em cada repetição.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int repeticoes = REPETICOES_PADRAO;
+    const char *kernel = NULL;
+    const char **entradas = (const char **)malloc(sizeof(char *) * (argc > 2 ? argc : 2));
+    int num_entradas = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeticoes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            kernel = argv[++i];
+        } else if (argv[i][0] == '-') {
+            imprimir_uso_benchmark(argv[0]);
+            return 1;
+        } else {
+            entradas[num_entradas++] = argv[i];
+        }
+    }
+    if (repeticoes < 1) {
+        imprimir_uso_benchmark(argv[0]);
+        return 1;
+    }
+    if (num_entradas == 0) {
+        entradas[num_entradas++] = CORPUS_PADRAO[0];
+        entradas[num_entradas++] = CORPUS_PADRAO[1];
+    }
+    if (!selecionar_kernels(kernel)) {
+        fprintf(stderr, "ERRO: Kernel '%s' desconhecido ou não suportado por esta CPU.\n", kernel);
+        return 1;
+    }
+
+    // Tempo de cada etapa em cada repetição, somado sobre o corpus
+    double *totais = (double *)calloc((size_t)NUM_ETAPAS * repeticoes, sizeof(double));
+    double *tempos = (double *)malloc(sizeof(double) * repeticoes);
+    long pixels_corpus = 0;
+    int imagens = 0;
+
+    printf("etapa,imagem,pixels,repeticoes,mpix_s,ns_pixel,variancia_ns_pixel\n");
+    for (int e = 0; e < num_entradas; ++e) {
+        size_t n;
+        char **lista = listar_entradas(entradas[e], &n);
+        for (size_t i = 0; i < n; ++i) {
+            DadosImagem d;
+            if (!preparar_dados(lista[i], &d)) {
+                fprintf(stderr, "AVISO: '%s' ignorada (não foi possível decodificar).\n", lista[i]);
+                continue;
+            }
+            long pixels = (long)d.rgb.width * d.rgb.height;
+            for (int k = 0; k < NUM_ETAPAS; ++k) {
+                ETAPAS[k].executar(&d); // Aquecimento (caches, reserva de buffers)
+                for (int r = 0; r < repeticoes; ++r) {
+                    tempos[r] = ETAPAS[k].executar(&d);
+                    totais[(size_t)k * repeticoes + r] += tempos[r];
+                }
+                imprimir_linha(ETAPAS[k].nome, lista[i], pixels, tempos, repeticoes);
+            }
+            fflush(stdout);
+            pixels_corpus += pixels;
+            imagens++;
+            liberar_dados(&d);
+        }
+        liberar_lista(lista, n);
+    }
+
+    if (imagens > 0) {
+        for (int k = 0; k < NUM_ETAPAS; ++k) {
+            imprimir_linha(ETAPAS[k].nome, "TODAS", pixels_corpus, totais + (size_t)k * repeticoes, repeticoes);
+        }
+    } else {
+        fprintf(stderr, "ERRO: Nenhuma imagem encontrada.\n");
+    }
+    free(tempos);
+    free(totais);
+    free(entradas);
+    return imagens > 0 ? 0 : 1;
+}
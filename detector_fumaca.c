@@ -5,10 +5,11 @@
 // na análise de cor pixel a pixel nos espaços RGB e HSI.
 //
 // Para compilar (no terminal):
-// gcc detector_fumaca.c -o detector -lm
+// gcc -O2 detector_fumaca.c -o detector -lm -lpthread
 //
 // Para executar:
-// ./detector
+// ./detector                 (analisa imagem_teste.jpg)
+// ./detector --rapido foto.jpg
 // =================================================================
 
 // -----------------------------------------------------------------
@@ -17,15 +18,67 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <stdbool.h> // Para usar o tipo 'bool' (true/false)
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+#include <dirent.h>
+
+// Incluído por outro arquivo (biblioteca fumaca.c, benchmark), o detector não
+// exporta nada: as funções internas e o stb ficam com ligação interna, e só a
+// API pública de quem o incluiu aparece para o ligador. Assim um programa que
+// também use o stb (ou tenha um pool_criar) liga com libfumaca.a sem conflito.
+#ifdef DETECTOR_SEM_MAIN
+#define DETECTOR_INTERNO static __attribute__((unused))
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_WRITE_STATIC
+#else
+#define DETECTOR_INTERNO
+#endif
+
+// As alocações do stb (decodificação e gravação) passam pela reserva de buffers
+// da seção 3, que reaproveita os blocos devolvidos.
+DETECTOR_INTERNO void *reserva_obter(size_t tamanho);
+DETECTOR_INTERNO void *reserva_realocar(void *p, size_t tamanho);
+DETECTOR_INTERNO void reserva_devolver(void *p);
+#define STBI_MALLOC(tamanho) reserva_obter(tamanho)
+#define STBI_REALLOC(p, tamanho) reserva_realocar(p, tamanho)
+#define STBI_FREE(p) reserva_devolver(p)
+#define STBIW_MALLOC(tamanho) reserva_obter(tamanho)
+#define STBIW_REALLOC(p, tamanho) reserva_realocar(p, tamanho)
+#define STBIW_FREE(p) reserva_devolver(p)
+
+#ifdef DETECTOR_SEM_MAIN
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function" // Partes do stb que o detector não usa
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#ifdef DETECTOR_SEM_MAIN
+#pragma GCC diagnostic pop
+#endif
+
+#include "hsi_vetorial.h" // Conversão RGB -> HSI vetorizada
 
 // -----------------------------------------------------------------
-// 2. DEFINIÇÃO DA ESTRUTURA DA IMAGEM
+// 2. DEFINIÇÃO DA ESTRUTURA DA IMAGEM E DOS LIMIARES
 // -----------------------------------------------------------------
 typedef struct {
     unsigned char *data;
@@ -34,19 +87,396 @@ typedef struct {
     int channels;
 } Image;
 
+// Limiares das regras de cor usadas na detecção de fumaça.
+typedef struct {
+    int brilho_minimo;      // RGB: todos os canais devem ser maiores que este valor
+    int tolerancia_cinza;   // RGB: diferença máxima (exclusiva) entre quaisquer dois canais
+    int saturacao_maxima;   // HSI: S (0-255) deve ser menor que este valor
+    int intensidade_minima; // HSI: I (0-255) deve ser maior que este valor
+} LimiaresFumaca;
+
+static const LimiaresFumaca LIMIARES_PADRAO = {190, 25, 50, 150};
+
+// -----------------------------------------------------------------
+// 3. RESERVA DE BUFFERS REUTILIZÁVEIS
+// -----------------------------------------------------------------
+// Cada imagem passa por vários buffers de megabytes (decodificação do stb,
+// máscaras, temporários da morfologia, compressão PNG). Com malloc/free a cada
+// imagem, cada buffer grande volta ao sistema e as suas páginas são zeradas e
+// mapeadas de novo (page faults). A reserva guarda os blocos devolvidos em
+// listas por classe de tamanho (4 classes por potência de 2, no máximo 25% de
+// folga) e os entrega de novo no próximo pedido da mesma classe: depois da
+// primeira imagem de uma resolução, o lote e o stream não pedem mais memória
+// ao sistema. Todas as threads compartilham a reserva (protegida por um mutex).
+
+#define RESERVA_CLASSES 176
+#define RESERVA_CABECALHO 16                     // Mantém o alinhamento de 16 bytes do malloc
+#define RESERVA_LIMITE_CACHE ((size_t)1 << 30)   // Acima disto, os blocos devolvidos vão ao sistema
+
+typedef struct {
+    pthread_mutex_t mutex;
+    void *livres[RESERVA_CLASSES];  // Listas encadeadas pelo primeiro ponteiro de cada bloco livre
+    size_t bytes_em_cache;
+    atomic_long alocacoes_heap;     // Blocos pedidos ao sistema desde o início
+} ReservaBuffers;
+
+static ReservaBuffers reserva = {PTHREAD_MUTEX_INITIALIZER, {NULL}, 0, 0};
+
+/**
+ * @brief Classe de um pedido e o tamanho real dos blocos dessa classe.
+ * @return -1 para pedidos grandes demais para a reserva (vão direto ao sistema).
+ */
+static int reserva_classe(size_t tamanho, size_t *tamanho_classe) {
+    if (tamanho <= 64) {
+        *tamanho_classe = 64;
+        return 0;
+    }
+    int k = 63 - __builtin_clzll((unsigned long long)(tamanho - 1)); // 2^k < tamanho <= 2^(k+1)
+    size_t base = (size_t)1 << k, passo = base / 4;
+    size_t sub = (tamanho - 1 - base) / passo;
+    *tamanho_classe = base + (sub + 1) * passo;
+    int classe = 1 + (k - 6) * 4 + (int)sub;
+    return classe < RESERVA_CLASSES ? classe : -1;
+}
+
+// Fica logo antes de cada bloco entregue.
+typedef struct {
+    size_t tamanho; // Capacidade do bloco
+    int classe;     // -1: bloco grande, devolvido direto ao sistema
+} CabecalhoReserva;
+
+_Static_assert(sizeof(CabecalhoReserva) <= RESERVA_CABECALHO, "cabeçalho da reserva");
+
+static inline CabecalhoReserva *reserva_cabecalho(void *p) {
+    return (CabecalhoReserva *)((unsigned char *)p - RESERVA_CABECALHO);
+}
+
+/**
+ * @brief Obtém um buffer de pelo menos 'tamanho' bytes (conteúdo indefinido).
+ * Devolva com reserva_devolver.
+ */
+DETECTOR_INTERNO void *reserva_obter(size_t tamanho) {
+    size_t tamanho_classe;
+    int classe = reserva_classe(tamanho, &tamanho_classe);
+    if (classe >= 0) {
+        pthread_mutex_lock(&reserva.mutex);
+        void *bloco = reserva.livres[classe];
+        if (bloco) {
+            reserva.livres[classe] = *(void **)bloco;
+            reserva.bytes_em_cache -= tamanho_classe;
+        }
+        pthread_mutex_unlock(&reserva.mutex);
+        if (bloco) return bloco;
+    } else {
+        tamanho_classe = tamanho;
+    }
+    unsigned char *base = (unsigned char *)malloc(RESERVA_CABECALHO + tamanho_classe);
+    if (!base) return NULL;
+    atomic_fetch_add(&reserva.alocacoes_heap, 1);
+    CabecalhoReserva *c = (CabecalhoReserva *)base;
+    c->tamanho = tamanho_classe;
+    c->classe = classe;
+    return base + RESERVA_CABECALHO;
+}
+
+/**
+ * @brief Como reserva_obter, com o buffer zerado (substitui calloc).
+ */
+DETECTOR_INTERNO void *reserva_obter_zerado(size_t tamanho) {
+    void *p = reserva_obter(tamanho);
+    if (p) memset(p, 0, tamanho);
+    return p;
+}
+
+DETECTOR_INTERNO void reserva_devolver(void *p) {
+    if (!p) return;
+    CabecalhoReserva *c = reserva_cabecalho(p);
+    if (c->classe >= 0) {
+        pthread_mutex_lock(&reserva.mutex);
+        if (reserva.bytes_em_cache + c->tamanho <= RESERVA_LIMITE_CACHE) {
+            *(void **)p = reserva.livres[c->classe];
+            reserva.livres[c->classe] = p;
+            reserva.bytes_em_cache += c->tamanho;
+            pthread_mutex_unlock(&reserva.mutex);
+            return;
+        }
+        pthread_mutex_unlock(&reserva.mutex);
+    }
+    free(c);
+}
+
+/**
+ * @brief realloc sobre a reserva: só copia quando o bloco atual não comporta o novo tamanho.
+ */
+DETECTOR_INTERNO void *reserva_realocar(void *p, size_t tamanho) {
+    if (!p) return reserva_obter(tamanho);
+    size_t capacidade = reserva_cabecalho(p)->tamanho;
+    if (tamanho <= capacidade) return p;
+    void *novo = reserva_obter(tamanho);
+    if (!novo) return NULL;
+    memcpy(novo, p, capacidade);
+    reserva_devolver(p);
+    return novo;
+}
+
+/**
+ * @brief Número de blocos pedidos ao sistema desde o início (depuração).
+ */
+DETECTOR_INTERNO long reserva_alocacoes_heap(void) {
+    return atomic_load(&reserva.alocacoes_heap);
+}
+
+// -----------------------------------------------------------------
+// 4. REGRAS DE COR POR PIXEL E KERNELS VETORIAIS DA REGRA RGB
+// -----------------------------------------------------------------
+
+/**
+ * @brief Regra RGB: pixel claro e acinzentado (mesma regra de segmentar_fumaca_rgb).
+ */
+static inline bool regra_rgb(int r, int g, int b, const LimiaresFumaca *lim) {
+    return r > lim->brilho_minimo && g > lim->brilho_minimo && b > lim->brilho_minimo &&
+           abs(r - g) < lim->tolerancia_cinza &&
+           abs(r - b) < lim->tolerancia_cinza &&
+           abs(g - b) < lim->tolerancia_cinza;
+}
+
+/**
+ * @brief Regra HSI: baixa saturação e intensidade alta.
+ * S e I vêm de hsi_saturacao_intensidade (hsi_vetorial.h), a mesma conta de
+ * rgb_para_hsi, para que o resultado seja idêntico ao do pipeline original.
+ * O matiz (H) não participa da regra e por isso não é calculado.
+ */
+static inline bool regra_hsi(int r_byte, int g_byte, int b_byte, const LimiaresFumaca *lim) {
+    float s, in;
+    hsi_saturacao_intensidade((unsigned char)r_byte, (unsigned char)g_byte, (unsigned char)b_byte, &s, &in);
+    unsigned char s_byte = (unsigned char)(s * 255.0f);
+    unsigned char in_byte = (unsigned char)(in * 255.0f);
+    return s_byte < lim->saturacao_maxima && in_byte > lim->intensidade_minima;
+}
+
+/**
+ * @brief Kernel da regra RGB para uma linha de 'n' pixels RGB (3 canais).
+ * Escreve 255/0 em 'mascara' (se não for NULL) e retorna quantos pixels passaram.
+ */
+typedef long (*KernelRegraRgb)(const unsigned char *rgb, int n, const LimiaresFumaca *lim, unsigned char *mascara);
+
+/**
+ * @brief Versão escalar da regra RGB. É a referência para as versões vetoriais.
+ */
+DETECTOR_INTERNO long regra_rgb_linha_escalar(const unsigned char *rgb, int n, const LimiaresFumaca *lim, unsigned char *mascara) {
+    long contagem = 0;
+    for (int x = 0; x < n; ++x) {
+        bool fumaca = regra_rgb(rgb[3 * x], rgb[3 * x + 1], rgb[3 * x + 2], lim);
+        contagem += fumaca;
+        if (mascara) mascara[x] = fumaca ? 255 : 0;
+    }
+    return contagem;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DETECTOR_X86 1
+
+// Máscaras de pshufb que separam 16 pixels RGB entrelaçados (48 bytes, em três
+// registradores de 16 bytes) nos planos R, G e B. Índice: [canal][bloco de 16 bytes].
+// -128 zera o byte de destino, permitindo juntar os três blocos com OR.
+static const signed char DESENTRELACAR_RGB[3][3][16] __attribute__((aligned(16))) = {
+    {
+        {   0,    3,    6,    9,   12,   15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128, -128,    2,    5,    8,   11,   14, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128,    1,    4,    7,   10,   13},
+    },
+    {
+        {   1,    4,    7,   10,   13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128,    0,    3,    6,    9,   12,   15, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128,    2,    5,    8,   11,   14},
+    },
+    {
+        {   2,    5,    8,   11,   14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128,    1,    4,    7,   10,   13, -128, -128, -128, -128, -128, -128},
+        {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128,    0,    3,    6,    9,   12,   15},
+    },
+};
+
+/**
+ * @brief Converte os limiares para a forma usada pelos kernels vetoriais.
+ * A regra equivale a min(r,g,b) >= brilho_minimo + 1 e max(r,g,b) - min(r,g,b) <= tolerancia_cinza - 1.
+ * @return false se nenhum pixel pode passar na regra (os kernels então só zeram a máscara).
+ */
+static bool preparar_limiares_vetoriais(const LimiaresFumaca *lim, int *minimo, int *maxima_diferenca) {
+    if (lim->brilho_minimo >= 255 || lim->tolerancia_cinza <= 0) return false;
+    *minimo = lim->brilho_minimo < 0 ? 0 : lim->brilho_minimo + 1;
+    *maxima_diferenca = lim->tolerancia_cinza > 256 ? 255 : lim->tolerancia_cinza - 1;
+    return true;
+}
+
+/**
+ * @brief Regra RGB com SSE4.1: 16 pixels por iteração, sem desvios.
+ * As comparações usam subtração saturada: (a -sat b) == 0 equivale a a <= b.
+ */
+__attribute__((target("sse4.1,popcnt")))
+DETECTOR_INTERNO long regra_rgb_linha_sse41(const unsigned char *rgb, int n, const LimiaresFumaca *lim, unsigned char *mascara) {
+    int minimo, maxima_diferenca;
+    if (!preparar_limiares_vetoriais(lim, &minimo, &maxima_diferenca)) {
+        if (mascara) memset(mascara, 0, n);
+        return 0;
+    }
+    const __m128i v_minimo = _mm_set1_epi8((char)minimo);
+    const __m128i v_diferenca = _mm_set1_epi8((char)maxima_diferenca);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sel[3][3];
+    for (int c = 0; c < 3; ++c)
+        for (int k = 0; k < 3; ++k) sel[c][k] = _mm_load_si128((const __m128i *)DESENTRELACAR_RGB[c][k]);
+
+    long contagem = 0;
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        const unsigned char *p = rgb + 3 * x;
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + 32));
+        __m128i ch[3];
+        for (int k = 0; k < 3; ++k) {
+            ch[k] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, sel[k][0]), _mm_shuffle_epi8(b, sel[k][1])),
+                                 _mm_shuffle_epi8(c, sel[k][2]));
+        }
+        __m128i mn = _mm_min_epu8(ch[0], _mm_min_epu8(ch[1], ch[2]));
+        __m128i mx = _mm_max_epu8(ch[0], _mm_max_epu8(ch[1], ch[2]));
+        __m128i claro = _mm_cmpeq_epi8(_mm_subs_epu8(v_minimo, mn), zero);
+        __m128i cinza = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_subs_epu8(mx, mn), v_diferenca), zero);
+        __m128i m = _mm_and_si128(claro, cinza);
+        if (mascara) _mm_storeu_si128((__m128i *)(mascara + x), m);
+        contagem += __builtin_popcount(_mm_movemask_epi8(m));
+    }
+    return contagem + regra_rgb_linha_escalar(rgb + 3 * x, n - x, lim, mascara ? mascara + x : NULL);
+}
+
+/**
+ * @brief Regra RGB com AVX2: 32 pixels por iteração.
+ * Cada metade de 128 bits recebe 16 pixels consecutivos, de modo que o mesmo
+ * pshufb (que opera por metade) separa os canais sem cruzar as metades.
+ */
+__attribute__((target("avx2,popcnt")))
+DETECTOR_INTERNO long regra_rgb_linha_avx2(const unsigned char *rgb, int n, const LimiaresFumaca *lim, unsigned char *mascara) {
+    int minimo, maxima_diferenca;
+    if (!preparar_limiares_vetoriais(lim, &minimo, &maxima_diferenca)) {
+        if (mascara) memset(mascara, 0, n);
+        return 0;
+    }
+    const __m256i v_minimo = _mm256_set1_epi8((char)minimo);
+    const __m256i v_diferenca = _mm256_set1_epi8((char)maxima_diferenca);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sel[3][3];
+    for (int c = 0; c < 3; ++c)
+        for (int k = 0; k < 3; ++k) sel[c][k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)DESENTRELACAR_RGB[c][k]));
+
+    long contagem = 0;
+    int x = 0;
+    for (; x + 32 <= n; x += 32) {
+        const unsigned char *p = rgb + 3 * x;
+        __m256i bloco[3];
+        for (int k = 0; k < 3; ++k) {
+            __m128i baixo = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+            __m128i alto = _mm_loadu_si128((const __m128i *)(p + 48 + 16 * k));
+            bloco[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(baixo), alto, 1);
+        }
+        __m256i ch[3];
+        for (int k = 0; k < 3; ++k) {
+            ch[k] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(bloco[0], sel[k][0]),
+                                                    _mm256_shuffle_epi8(bloco[1], sel[k][1])),
+                                    _mm256_shuffle_epi8(bloco[2], sel[k][2]));
+        }
+        __m256i mn = _mm256_min_epu8(ch[0], _mm256_min_epu8(ch[1], ch[2]));
+        __m256i mx = _mm256_max_epu8(ch[0], _mm256_max_epu8(ch[1], ch[2]));
+        __m256i claro = _mm256_cmpeq_epi8(_mm256_subs_epu8(v_minimo, mn), zero);
+        __m256i cinza = _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_subs_epu8(mx, mn), v_diferenca), zero);
+        __m256i m = _mm256_and_si256(claro, cinza);
+        if (mascara) _mm256_storeu_si256((__m256i *)(mascara + x), m);
+        contagem += __builtin_popcount((unsigned)_mm256_movemask_epi8(m));
+    }
+    return contagem + regra_rgb_linha_escalar(rgb + 3 * x, n - x, lim, mascara ? mascara + x : NULL);
+}
+#endif
+
+/**
+ * @brief Conta os bits ligados em 'n' palavras de 64 bits.
+ */
+typedef long (*KernelContarBits)(const uint64_t *palavras, size_t n);
+
+DETECTOR_INTERNO long contar_bits_escalar(const uint64_t *palavras, size_t n) {
+    long contagem = 0;
+    for (size_t i = 0; i < n; ++i) contagem += __builtin_popcountll(palavras[i]);
+    return contagem;
+}
+
+#ifdef DETECTOR_X86
+// Mesmo código, mas compilado para a instrução POPCNT do processador.
+__attribute__((target("popcnt")))
+DETECTOR_INTERNO long contar_bits_popcnt(const uint64_t *palavras, size_t n) {
+    long contagem = 0;
+    for (size_t i = 0; i < n; ++i) contagem += __builtin_popcountll(palavras[i]);
+    return contagem;
+}
+#endif
+
+// Kernels escolhidos em tempo de execução por selecionar_kernels().
+static KernelRegraRgb kernel_regra_rgb = regra_rgb_linha_escalar;
+static KernelContarBits kernel_contar_bits = contar_bits_escalar;
+
+/**
+ * @brief Escolhe os melhores kernels (regra RGB, conversão HSI e contagem de bits) suportados pela CPU (via cpuid).
+ * @param forcar Nome do kernel desejado ("escalar", "sse41", "avx2") ou NULL para o melhor disponível.
+ * @return false se o kernel pedido não existe ou não é suportado por esta CPU.
+ */
+DETECTOR_INTERNO bool selecionar_kernels(const char *forcar) {
+    if (!hsi_selecionar_kernel(forcar)) return false;
+    kernel_regra_rgb = regra_rgb_linha_escalar;
+    kernel_contar_bits = contar_bits_escalar;
+    if (forcar && strcmp(forcar, "escalar") == 0) return true;
+#ifdef DETECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt")) kernel_contar_bits = contar_bits_popcnt;
+    bool tem_sse41 = __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+    bool tem_avx2 = tem_sse41 && __builtin_cpu_supports("avx2");
+    if (forcar == NULL || strcmp(forcar, "avx2") == 0) {
+        if (tem_avx2) {
+            kernel_regra_rgb = regra_rgb_linha_avx2;
+            return true;
+        }
+        if (forcar) return false;
+    }
+    if (forcar == NULL || strcmp(forcar, "sse41") == 0) {
+        if (tem_sse41) {
+            kernel_regra_rgb = regra_rgb_linha_sse41;
+            return true;
+        }
+        if (forcar) return false;
+    }
+#endif
+    return forcar == NULL;
+}
+
 // -----------------------------------------------------------------
-// 3. FUNÇÕES DE PROCESSAMENTO
+// 5. FUNÇÕES DE PROCESSAMENTO
 // -----------------------------------------------------------------
+// As Images devolvidas por estas funções vêm da reserva: libere com
+// reserva_devolver (ou stbi_image_free, que aponta para o mesmo lugar).
 
 /**
  * @brief Segmenta pixels de fumaça com base em regras de cor no espaço RGB.
  * A fumaça em RGB geralmente é clara (R,G,B altos) e acinzentada (R,G,B próximos).
+ * Imagens de 3 canais usam o kernel escolhido por selecionar_kernels().
  */
-Image segmentar_fumaca_rgb(Image *img) {
-    unsigned char *output_data = (unsigned char *)malloc(img->width * img->height);
+DETECTOR_INTERNO Image segmentar_fumaca_rgb(Image *img) {
+    unsigned char *output_data = (unsigned char *)reserva_obter((size_t)img->width * img->height);
     Image mascara = {output_data, img->width, img->height, 1};
-    const int BRILHO_MINIMO = 190;
-    const int TOLERANCIA_CINZA = 25;
+    if (img->channels == 3) {
+        kernel_regra_rgb(img->data, img->width * img->height, &LIMIARES_PADRAO, mascara.data);
+        return mascara;
+    }
+
+    const int BRILHO_MINIMO = LIMIARES_PADRAO.brilho_minimo;
+    const int TOLERANCIA_CINZA = LIMIARES_PADRAO.tolerancia_cinza;
 
     for (int i = 0; i < img->width * img->height; ++i) {
         unsigned char r = img->data[i * img->channels];
@@ -67,29 +497,21 @@ Image segmentar_fumaca_rgb(Image *img) {
 
 /**
  * @brief Converte uma imagem do espaço de cor RGB para HSI.
+ * Imagens de 3 canais usam o kernel vetorial de hsi_vetorial.h.
  */
-Image rgb_para_hsi(Image *img) {
-    unsigned char *hsi_data = (unsigned char *)malloc(img->width * img->height * 3);
+DETECTOR_INTERNO Image rgb_para_hsi(Image *img) {
+    unsigned char *hsi_data = (unsigned char *)reserva_obter((size_t)img->width * img->height * 3);
     Image img_hsi = {hsi_data, img->width, img->height, 3};
+    if (img->channels == 3) {
+        hsi_converter_bytes(img->data, img->width * img->height, img_hsi.data);
+        return img_hsi;
+    }
 
+    // Outro número de canais: a mesma conversão de referência, pixel a pixel
     for (int i = 0; i < img->width * img->height; ++i) {
-        float r = img->data[i * img->channels] / 255.0f;
-        float g = img->data[i * img->channels + 1] / 255.0f;
-        float b = img->data[i * img->channels + 2] / 255.0f;
-        float h = 0.0, s = 0.0, in = (r + g + b) / 3.0f;
-
-        float min_val = fmin(r, fmin(g, b));
-        if (in > 0.001) s = 1.0f - min_val / in;
-        
-        if (s > 0.001) {
-            float num = 0.5f * ((r - g) + (r - b));
-            float den = sqrtf((r - g) * (r - g) + (r - b) * (g - b));
-            if (den > 0.001) {
-                float theta = acosf(num / den) * (180.0 / M_PI);
-                if (b > g) h = 360.0f - theta; else h = theta;
-            }
-        }
-        
+        const unsigned char *p = img->data + (size_t)i * img->channels;
+        float h, s, in;
+        hsi_pixel_escalar(p[0], p[1], p[2], &h, &s, &in);
         img_hsi.data[i * 3]     = (unsigned char)(h / 360.0f * 255.0f); // H
         img_hsi.data[i * 3 + 1] = (unsigned char)(s * 255.0f);         // S
         img_hsi.data[i * 3 + 2] = (unsigned char)(in * 255.0f);       // I
@@ -101,11 +523,11 @@ Image rgb_para_hsi(Image *img) {
  * @brief Segmenta pixels de fumaça com base em regras no espaço HSI.
  * A fumaça em HSI tem baixa Saturação (S) e média a alta Intensidade (I).
  */
-Image segmentar_fumaca_hsi(Image *img_hsi) {
-    unsigned char *output_data = (unsigned char *)malloc(img_hsi->width * img_hsi->height);
+DETECTOR_INTERNO Image segmentar_fumaca_hsi(Image *img_hsi) {
+    unsigned char *output_data = (unsigned char *)reserva_obter((size_t)img_hsi->width * img_hsi->height);
     Image mascara = {output_data, img_hsi->width, img_hsi->height, 1};
-    const int SATURACAO_MAXIMA = 50; // Quão "cinza" o pixel deve ser (quanto menor, mais cinza)
-    const int INTENSIDADE_MINIMA = 150; // Quão "claro" o pixel deve ser
+    const int SATURACAO_MAXIMA = LIMIARES_PADRAO.saturacao_maxima; // Quão "cinza" o pixel deve ser (quanto menor, mais cinza)
+    const int INTENSIDADE_MINIMA = LIMIARES_PADRAO.intensidade_minima; // Quão "claro" o pixel deve ser
 
     for (int i = 0; i < img_hsi->width * img_hsi->height; ++i) {
         unsigned char s = img_hsi->data[i * 3 + 1];
@@ -123,8 +545,8 @@ Image segmentar_fumaca_hsi(Image *img_hsi) {
 /**
  * @brief Combina duas máscaras usando uma operação lógica E (AND).
  */
-Image combinar_mascaras(Image *mascara_a, Image *mascara_b) {
-    unsigned char *output_data = (unsigned char *)malloc(mascara_a->width * mascara_a->height);
+DETECTOR_INTERNO Image combinar_mascaras(Image *mascara_a, Image *mascara_b) {
+    unsigned char *output_data = (unsigned char *)reserva_obter((size_t)mascara_a->width * mascara_a->height);
     Image mascara_final = {output_data, mascara_a->width, mascara_a->height, 1};
     for (int i = 0; i < mascara_a->width * mascara_a->height; ++i) {
         if (mascara_a->data[i] == 255 && mascara_b->data[i] == 255) {
@@ -137,73 +559,3326 @@ Image combinar_mascaras(Image *mascara_a, Image *mascara_b) {
 }
 
 /**
- * @brief Analisa a máscara final para decidir se há fumaça.
+ * @brief Decide se há fumaça a partir da contagem de pixels classificados.
+ */
+DETECTOR_INTERNO bool avaliar_contagem_fumaca(long smoke_pixel_count, long total_pixels, float threshold_percent) {
+    float smoke_percentage = 100.0f * smoke_pixel_count / total_pixels;
+    printf("Análise: %.4f%% da imagem foi classificada como fumaça.\n", smoke_percentage);
+    return smoke_percentage > threshold_percent;
+}
+
+/**
+ * @brief Conta os pixels de fumaça (255) de uma máscara de 1 canal.
  */
-bool verificar_presenca_fumaca(Image *mascara, float threshold_percent) {
+DETECTOR_INTERNO long contar_mascara(const Image *mascara) {
     long smoke_pixel_count = 0;
-    long total_pixels = mascara->width * mascara->height;
-    for (int i = 0; i < total_pixels; ++i) {
+    long total_pixels = (long)mascara->width * mascara->height;
+    for (long i = 0; i < total_pixels; ++i) {
         if (mascara->data[i] == 255) {
             smoke_pixel_count++;
         }
     }
+    return smoke_pixel_count;
+}
 
-    float smoke_percentage = 100.0f * smoke_pixel_count / total_pixels;
-    printf("Análise: %.4f%% da imagem foi classificada como fumaça.\n", smoke_percentage);
-    return smoke_percentage > threshold_percent;
+/**
+ * @brief Analisa a máscara final para decidir se há fumaça.
+ */
+DETECTOR_INTERNO bool verificar_presenca_fumaca(Image *mascara, float threshold_percent) {
+    long total_pixels = (long)mascara->width * mascara->height;
+    return avaliar_contagem_fumaca(contar_mascara(mascara), total_pixels, threshold_percent);
 }
 
 // -----------------------------------------------------------------
-// 4. FUNÇÃO PRINCIPAL (MAIN)
+// 6. MÁSCARAS DE 1 BIT POR PIXEL
 // -----------------------------------------------------------------
-int main() {
-    int width, height, channels;
-    unsigned char *data = stbi_load("imagem_teste.jpg", &width, &height, &channels, 0);
-    if (data == NULL) {
-        printf("ERRO: Não foi possível carregar a imagem.\n");
-        printf("Verifique se 'imagem_teste.jpg' está na mesma pasta do executável.\n");
-        return 1;
+// Internamente as máscaras guardam um bit por pixel (em vez de um byte 0/255):
+// a combinação E vira um AND de palavras de 64 bits e a contagem usa a
+// instrução POPCNT, com 8x menos tráfego de memória por etapa. A máscara só é
+// expandida para 8 bits quando precisa ser gravada em PNG.
+
+typedef struct {
+    uint64_t *palavras;      // Linha y começa em palavras + y * palavras_por_linha
+    int width;
+    int height;
+    int palavras_por_linha;  // (width + 63) / 64; os bits além de 'width' ficam sempre em zero
+} MascaraBits;
+
+// Pixels processados por vez nas etapas que passam por um buffer de bytes na pilha.
+#define PIXELS_POR_BLOCO 1024
+
+DETECTOR_INTERNO MascaraBits mascara_bits_criar(int width, int height) {
+    MascaraBits m = {NULL, width, height, (width + 63) / 64};
+    m.palavras = (uint64_t *)reserva_obter_zerado((size_t)m.palavras_por_linha * height * sizeof(uint64_t));
+    return m;
+}
+
+DETECTOR_INTERNO void mascara_bits_liberar(MascaraBits *m) {
+    reserva_devolver(m->palavras);
+    m->palavras = NULL;
+}
+
+static inline uint64_t *mascara_bits_linha(const MascaraBits *m, int y) {
+    return m->palavras + (size_t)y * m->palavras_por_linha;
+}
+
+/**
+ * @brief Empacota 'n' bytes de máscara (0 ou 255) em bits, a partir do bit 0 de 'bits'.
+ * Os bits da última palavra além de 'n' são zerados.
+ */
+DETECTOR_INTERNO void empacotar_mascara_linha(const unsigned char *bytes, int n, uint64_t *bits) {
+    int x = 0;
+#ifdef __SSE2__
+    // movemask junta o bit mais alto de 16 bytes: 255 -> 1, 0 -> 0
+    for (; x + 64 <= n; x += 64) {
+        uint64_t palavra = 0;
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(bytes + x + 16 * k));
+            palavra |= (uint64_t)(uint16_t)_mm_movemask_epi8(v) << (16 * k);
+        }
+        bits[x / 64] = palavra;
+    }
+#endif
+    for (; x < n; x += 64) {
+        uint64_t palavra = 0;
+        int fim = n - x < 64 ? n - x : 64;
+        for (int k = 0; k < fim; ++k) palavra |= (uint64_t)(bytes[x + k] != 0) << k;
+        bits[x / 64] = palavra;
     }
-    Image img = {data, width, height, channels};
-    printf("Imagem '%s' carregada: %d x %d, Canais: %d\n\n", "imagem_teste.jpg", img.width, img.height, img.channels);
+}
 
-    // ETAPA 1: Segmentação com RGB
-    Image mascara_rgb = segmentar_fumaca_rgb(&img);
-    stbi_write_png("resultado_fumaca_rgb.png", mascara_rgb.width, mascara_rgb.height, 1, mascara_rgb.data, mascara_rgb.width);
-    printf("Passo 1: Máscara RGB salva como 'resultado_fumaca_rgb.png'\n");
+/**
+ * @brief Expande 'n' bits em bytes 0/255.
+ */
+DETECTOR_INTERNO void expandir_mascara_linha(const uint64_t *bits, int n, unsigned char *bytes) {
+    for (int x = 0; x < n; ++x) {
+        bytes[x] = (unsigned char)(0u - (unsigned)((bits[x >> 6] >> (x & 63)) & 1u));
+    }
+}
 
-    // ETAPA 2: Conversão para HSI e Segmentação
-    Image img_hsi = rgb_para_hsi(&img);
-    Image mascara_hsi = segmentar_fumaca_hsi(&img_hsi);
-    stbi_write_png("resultado_fumaca_hsi.png", mascara_hsi.width, mascara_hsi.height, 1, mascara_hsi.data, mascara_hsi.width);
-    printf("Passo 2: Máscara HSI salva como 'resultado_fumaca_hsi.png'\n");
+/**
+ * @brief Expande a máscara de bits para uma Image de 1 canal (0/255), por exemplo para gravar em PNG.
+ */
+DETECTOR_INTERNO Image mascara_bits_para_image(const MascaraBits *m) {
+    unsigned char *dados = (unsigned char *)reserva_obter((size_t)m->width * m->height);
+    Image img = {dados, m->width, m->height, 1};
+    for (int y = 0; y < m->height; ++y) {
+        expandir_mascara_linha(mascara_bits_linha(m, y), m->width, dados + (size_t)y * m->width);
+    }
+    return img;
+}
 
-    // ETAPA 3: Combinar as máscaras
-    Image mascara_final = combinar_mascaras(&mascara_rgb, &mascara_hsi);
-    stbi_write_png("resultado_fumaca_final.png", mascara_final.width, mascara_final.height, 1, mascara_final.data, mascara_final.width);
-    printf("Passo 3: Máscara combinada salva como 'resultado_fumaca_final.png'\n\n");
+/**
+ * @brief Grava a máscara de bits em PNG (a única etapa que precisa de 8 bits por pixel).
+ */
+DETECTOR_INTERNO bool salvar_mascara_bits_png(const char *caminho, const MascaraBits *m) {
+    Image img = mascara_bits_para_image(m);
+    int ok = stbi_write_png(caminho, img.width, img.height, 1, img.data, img.width);
+    reserva_devolver(img.data);
+    return ok != 0;
+}
 
-    // ETAPA 4: Tomar a decisão final
-    float deteccao_threshold = 0.2; // Limiar: alerta se mais de 0.2% da imagem for fumaça.
-    bool fumaca_detectada = verificar_presenca_fumaca(&mascara_final, deteccao_threshold);
+/**
+ * @brief Regra RGB em bits. Os bytes de cada bloco de pixels ficam só na pilha (cache L1).
+ */
+DETECTOR_INTERNO MascaraBits segmentar_fumaca_rgb_bits(const Image *img, const LimiaresFumaca *lim) {
+    MascaraBits m = mascara_bits_criar(img->width, img->height);
+    unsigned char bloco[PIXELS_POR_BLOCO];
+    for (int y = 0; y < img->height; ++y) {
+        const unsigned char *linha = img->data + (size_t)y * img->width * img->channels;
+        uint64_t *bits = mascara_bits_linha(&m, y);
+        for (int x0 = 0; x0 < img->width; x0 += PIXELS_POR_BLOCO) {
+            int n = img->width - x0 < PIXELS_POR_BLOCO ? img->width - x0 : PIXELS_POR_BLOCO;
+            const unsigned char *p = linha + (size_t)x0 * img->channels;
+            if (img->channels == 3) {
+                kernel_regra_rgb(p, n, lim, bloco);
+            } else {
+                for (int x = 0; x < n; ++x) {
+                    const unsigned char *px = p + (size_t)x * img->channels;
+                    bloco[x] = regra_rgb(px[0], px[1], px[2], lim) ? 255 : 0;
+                }
+            }
+            empacotar_mascara_linha(bloco, n, bits + x0 / 64);
+        }
+    }
+    return m;
+}
 
-    if (fumaca_detectada) {
-        printf("\n=======================================================\n");
-        printf(">>> ALERTA: Possível foco de fumaça detectado! <<<\n");
-        printf("=======================================================\n");
+/**
+ * @brief Regra HSI em bits, direto da imagem RGB: a conversão HSI é feita bloco a
+ * bloco na pilha, sem criar a imagem HSI inteira.
+ */
+DETECTOR_INTERNO MascaraBits segmentar_fumaca_hsi_bits(const Image *img, const LimiaresFumaca *lim) {
+    MascaraBits m = mascara_bits_criar(img->width, img->height);
+    unsigned char hsi[PIXELS_POR_BLOCO * 3];
+    unsigned char bloco[PIXELS_POR_BLOCO];
+    for (int y = 0; y < img->height; ++y) {
+        const unsigned char *linha = img->data + (size_t)y * img->width * img->channels;
+        uint64_t *bits = mascara_bits_linha(&m, y);
+        for (int x0 = 0; x0 < img->width; x0 += PIXELS_POR_BLOCO) {
+            int n = img->width - x0 < PIXELS_POR_BLOCO ? img->width - x0 : PIXELS_POR_BLOCO;
+            const unsigned char *p = linha + (size_t)x0 * img->channels;
+            if (img->channels == 3) {
+                hsi_converter_bytes(p, n, hsi);
+                for (int x = 0; x < n; ++x) {
+                    bloco[x] = (hsi[3 * x + 1] < lim->saturacao_maxima && hsi[3 * x + 2] > lim->intensidade_minima) ? 255 : 0;
+                }
+            } else {
+                for (int x = 0; x < n; ++x) {
+                    const unsigned char *px = p + (size_t)x * img->channels;
+                    bloco[x] = regra_hsi(px[0], px[1], px[2], lim) ? 255 : 0;
+                }
+            }
+            empacotar_mascara_linha(bloco, n, bits + x0 / 64);
+        }
+    }
+    return m;
+}
+
+/**
+ * @brief Combina duas máscaras de bits com E lógico, 64 pixels por operação.
+ */
+DETECTOR_INTERNO MascaraBits combinar_mascaras_bits(const MascaraBits *a, const MascaraBits *b) {
+    MascaraBits m = mascara_bits_criar(a->width, a->height);
+    size_t total = (size_t)a->palavras_por_linha * a->height;
+    for (size_t i = 0; i < total; ++i) m.palavras[i] = a->palavras[i] & b->palavras[i];
+    return m;
+}
+
+/**
+ * @brief Conta os pixels ligados da máscara com POPCNT.
+ */
+DETECTOR_INTERNO long contar_mascara_bits(const MascaraBits *m) {
+    return kernel_contar_bits(m->palavras, (size_t)m->palavras_por_linha * m->height);
+}
+
+/**
+ * @brief Versão de verificar_presenca_fumaca para máscaras de bits.
+ */
+DETECTOR_INTERNO bool verificar_presenca_fumaca_bits(const MascaraBits *mascara, float threshold_percent) {
+    return avaliar_contagem_fumaca(contar_mascara_bits(mascara), (long)mascara->width * mascara->height,
+                                   threshold_percent);
+}
+
+// -----------------------------------------------------------------
+// 7. MOTOR FUNDIDO (PASSADA ÚNICA)
+// -----------------------------------------------------------------
+// As funções acima fazem uma varredura completa da imagem por etapa e
+// alocam uma imagem intermediária para cada uma (inclusive a cópia HSI
+// de 3 bytes por pixel). O motor fundido lê cada pixel RGB uma única vez,
+// aplica as duas regras e escreve apenas a máscara final (ou nenhuma),
+// contando os pixels de fumaça durante a própria passada.
+
+/**
+ * @brief Classifica uma linha de 'n' pixels com as duas regras em uma única passada.
+ * A regra RGB (só inteiros) é avaliada primeiro; a regra HSI só é calculada
+ * para os pixels que passaram nela. Se 'mascara' for NULL, apenas conta.
+ * @return Número de pixels de fumaça na linha.
+ */
+DETECTOR_INTERNO long classificar_linha_fundida(const unsigned char *rgb, int canais, int n,
+                               const LimiaresFumaca *lim, unsigned char *mascara) {
+    long contagem = 0;
+    if (canais == 3) {
+        // A regra RGB roda no kernel vetorial por blocos; a HSI só revisita os candidatos.
+        unsigned char candidatos[1024];
+        for (int x0 = 0; x0 < n; x0 += (int)sizeof(candidatos)) {
+            int bloco = n - x0 < (int)sizeof(candidatos) ? n - x0 : (int)sizeof(candidatos);
+            const unsigned char *p = rgb + (size_t)x0 * 3;
+            unsigned char *m = mascara ? mascara + x0 : candidatos;
+            if (kernel_regra_rgb(p, bloco, lim, m) == 0) continue;
+            for (int x = 0; x < bloco; ++x) {
+                if (m[x] && !regra_hsi(p[3 * x], p[3 * x + 1], p[3 * x + 2], lim)) m[x] = 0;
+                contagem += m[x] != 0;
+            }
+        }
+        return contagem;
+    }
+    for (int x = 0; x < n; ++x) {
+        const unsigned char *p = rgb + (size_t)x * canais;
+        bool fumaca = regra_rgb(p[0], p[1], p[2], lim) && regra_hsi(p[0], p[1], p[2], lim);
+        contagem += fumaca;
+        if (mascara) mascara[x] = fumaca ? 255 : 0;
+    }
+    return contagem;
+}
+
+/**
+ * @brief Aplica o motor fundido à imagem inteira.
+ * @param mascara Buffer de largura*altura bytes para a máscara final, ou NULL.
+ * @return Número de pixels de fumaça.
+ */
+DETECTOR_INTERNO long classificar_fumaca_fundido(const Image *img, const LimiaresFumaca *lim, unsigned char *mascara) {
+    long contagem = 0;
+    size_t bytes_linha = (size_t)img->width * img->channels;
+    for (int y = 0; y < img->height; ++y) {
+        contagem += classificar_linha_fundida(img->data + y * bytes_linha, img->channels, img->width, lim,
+                                              mascara ? mascara + (size_t)y * img->width : NULL);
+    }
+    return contagem;
+}
+
+// -----------------------------------------------------------------
+// 8. TABELA DE CONSULTA RGB -> FUMAÇA (2^24 BITS)
+// -----------------------------------------------------------------
+// Todas as regras dependem apenas do trio (r,g,b). Uma tabela de 2^24 bits
+// (2 MB) responde "este pixel é fumaça?" com uma única leitura, qualquer que
+// seja a complexidade das regras. A tabela é construída a partir dos limiares
+// ativos e pode ser salva em disco e mapeada (mmap) por vários processos,
+// que passam a compartilhar uma única cópia na memória.
+
+#define TABELA_FUMACA_ENTRADAS (1u << 24)
+#define TABELA_FUMACA_PALAVRAS (TABELA_FUMACA_ENTRADAS / 64)
+#define TABELA_FUMACA_CABECALHO 64 // bytes antes dos bits no arquivo (mantém o alinhamento de 64 bits)
+#define TABELA_FUMACA_ASSINATURA "FUMACALUT1"
+
+typedef struct {
+    const uint64_t *bits;     // Bit (r << 16) | (g << 8) | b ligado = fumaça
+    LimiaresFumaca limiares;  // Limiares usados na construção
+    void *memoria;            // Bits alocados por tabela_construir (NULL se mapeada)
+    void *mapeamento;         // Arquivo mapeado por tabela_mapear (NULL se alocada)
+    size_t tamanho_mapeamento;
+} TabelaFumaca;
+
+// Cabeçalho do arquivo da tabela; os bits começam em TABELA_FUMACA_CABECALHO.
+typedef struct {
+    char assinatura[16];
+    LimiaresFumaca limiares;
+} CabecalhoTabelaFumaca;
+
+static inline uint32_t indice_tabela(unsigned char r, unsigned char g, unsigned char b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+/**
+ * @brief Constrói a tabela em memória aplicando as regras a todas as 2^24 cores.
+ */
+DETECTOR_INTERNO bool tabela_construir(TabelaFumaca *tabela, const LimiaresFumaca *lim) {
+    uint64_t *bits = (uint64_t *)calloc(TABELA_FUMACA_PALAVRAS, sizeof(uint64_t));
+    if (!bits) return false;
+    for (int r = 0; r < 256; ++r) {
+        for (int g = 0; g < 256; ++g) {
+            for (int b = 0; b < 256; ++b) {
+                if (regra_rgb(r, g, b, lim) && regra_hsi(r, g, b, lim)) {
+                    uint32_t i = indice_tabela(r, g, b);
+                    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+                }
+            }
+        }
+    }
+    tabela->bits = bits;
+    tabela->limiares = *lim;
+    tabela->memoria = bits;
+    tabela->mapeamento = NULL;
+    tabela->tamanho_mapeamento = 0;
+    return true;
+}
+
+/**
+ * @brief Salva a tabela em disco. Escreve em um arquivo temporário e renomeia,
+ * para que outro processo nunca mapeie um arquivo pela metade. O nome do
+ * temporário leva o PID e um contador, para que dois processos (ou dois
+ * contextos da biblioteca) construindo a mesma tabela ao mesmo tempo não
+ * escrevam no mesmo arquivo; o último rename vence, e os dois são completos.
+ */
+DETECTOR_INTERNO bool tabela_salvar(const TabelaFumaca *tabela, const char *caminho) {
+    static atomic_uint sequencia;
+    char temporario[1024];
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    snprintf(temporario, sizeof(temporario), "%s.%lu.%u.tmp", caminho, pid, atomic_fetch_add(&sequencia, 1));
+    FILE *f = fopen(temporario, "wb");
+    if (!f) return false;
+
+    unsigned char cabecalho[TABELA_FUMACA_CABECALHO] = {0};
+    CabecalhoTabelaFumaca info = {{0}, tabela->limiares};
+    memcpy(info.assinatura, TABELA_FUMACA_ASSINATURA, sizeof(TABELA_FUMACA_ASSINATURA));
+    memcpy(cabecalho, &info, sizeof(info));
+    bool ok = fwrite(cabecalho, 1, sizeof(cabecalho), f) == sizeof(cabecalho) &&
+              fwrite(tabela->bits, sizeof(uint64_t), TABELA_FUMACA_PALAVRAS, f) == TABELA_FUMACA_PALAVRAS;
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    if (ok) ok = MoveFileExA(temporario, caminho, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if (ok) ok = rename(temporario, caminho) == 0;
+#endif
+    if (!ok) remove(temporario);
+    return ok;
+}
+
+/**
+ * @brief Mapeia (somente leitura, compartilhado) uma tabela salva por tabela_salvar.
+ * @return false se o arquivo não existe, está truncado ou foi gerado com outros limiares.
+ */
+DETECTOR_INTERNO bool tabela_mapear(TabelaFumaca *tabela, const char *caminho, const LimiaresFumaca *lim) {
+    size_t tamanho = TABELA_FUMACA_CABECALHO + TABELA_FUMACA_PALAVRAS * sizeof(uint64_t);
+    void *base = NULL;
+#ifdef _WIN32
+    HANDLE arquivo = CreateFileA(caminho, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (arquivo == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER tamanho_arquivo;
+    if (GetFileSizeEx(arquivo, &tamanho_arquivo) && (size_t)tamanho_arquivo.QuadPart == tamanho) {
+        HANDLE mapa = CreateFileMappingA(arquivo, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapa) {
+            base = MapViewOfFile(mapa, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapa);
+        }
+    }
+    CloseHandle(arquivo);
+#else
+    int fd = open(caminho, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == tamanho) {
+        base = mmap(NULL, tamanho, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) base = NULL;
+    }
+    close(fd);
+#endif
+    if (!base) return false;
+
+    CabecalhoTabelaFumaca info;
+    memcpy(&info, base, sizeof(info));
+    if (memcmp(info.assinatura, TABELA_FUMACA_ASSINATURA, sizeof(TABELA_FUMACA_ASSINATURA)) != 0 ||
+        memcmp(&info.limiares, lim, sizeof(*lim)) != 0) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, tamanho);
+#endif
+        return false;
+    }
+    tabela->bits = (const uint64_t *)((const unsigned char *)base + TABELA_FUMACA_CABECALHO);
+    tabela->limiares = *lim;
+    tabela->memoria = NULL;
+    tabela->mapeamento = base;
+    tabela->tamanho_mapeamento = tamanho;
+    return true;
+}
+
+DETECTOR_INTERNO void tabela_liberar(TabelaFumaca *tabela) {
+    if (tabela->mapeamento) {
+#ifdef _WIN32
+        UnmapViewOfFile(tabela->mapeamento);
+#else
+        munmap(tabela->mapeamento, tabela->tamanho_mapeamento);
+#endif
+    }
+    free(tabela->memoria);
+    memset(tabela, 0, sizeof(*tabela));
+}
+
+/**
+ * @brief Obtém a tabela para os limiares ativos: mapeia o arquivo se ele for
+ * compatível; senão constrói, salva e passa a usar a cópia mapeada.
+ * Se o arquivo não puder ser gravado, segue com a tabela em memória.
+ */
+DETECTOR_INTERNO bool tabela_carregar_ou_construir(TabelaFumaca *tabela, const char *caminho, const LimiaresFumaca *lim) {
+    if (tabela_mapear(tabela, caminho, lim)) return true;
+    if (!tabela_construir(tabela, lim)) return false;
+    if (tabela_salvar(tabela, caminho)) {
+        TabelaFumaca mapeada;
+        if (tabela_mapear(&mapeada, caminho, lim)) {
+            tabela_liberar(tabela);
+            *tabela = mapeada;
+        }
     } else {
-        printf("\n========================================================\n");
-        printf(">>> Nenhum sinal significativo de fumaça detectado. <<<\n");
-        printf("========================================================\n");
+        printf("AVISO: Não foi possível salvar a tabela em '%s'; usando cópia em memória.\n", caminho);
     }
+    return true;
+}
 
-    // ETAPA 5: Liberar toda a memória alocada
-    stbi_image_free(img.data);
-    free(mascara_rgb.data);
-    free(img_hsi.data);
-    free(mascara_hsi.data);
-    free(mascara_final.data);
-    
-    printf("\nProcesso concluído.\n");
-    return 0;
-}
\ No newline at end of file
+/**
+ * @brief Classifica uma linha consultando a tabela (uma leitura por pixel, sem desvios).
+ * @return Número de pixels de fumaça na linha.
+ */
+DETECTOR_INTERNO long classificar_linha_tabela(const TabelaFumaca *tabela, const unsigned char *rgb, int canais, int n,
+                              unsigned char *mascara) {
+    const uint64_t *bits = tabela->bits;
+    long contagem = 0;
+    for (int x = 0; x < n; ++x) {
+        const unsigned char *p = rgb + (size_t)x * canais;
+        uint32_t i = indice_tabela(p[0], p[1], p[2]);
+        unsigned bit = (unsigned)(bits[i >> 6] >> (i & 63)) & 1u;
+        contagem += bit;
+        if (mascara) mascara[x] = (unsigned char)(0u - bit);
+    }
+    return contagem;
+}
+
+/**
+ * @brief Classifica a imagem inteira com a tabela.
+ * @param mascara Buffer de largura*altura bytes para a máscara final, ou NULL.
+ */
+DETECTOR_INTERNO long classificar_fumaca_tabela(const TabelaFumaca *tabela, const Image *img, unsigned char *mascara) {
+    long contagem = 0;
+    size_t bytes_linha = (size_t)img->width * img->channels;
+    for (int y = 0; y < img->height; ++y) {
+        contagem += classificar_linha_tabela(tabela, img->data + y * bytes_linha, img->channels, img->width,
+                                             mascara ? mascara + (size_t)y * img->width : NULL);
+    }
+    return contagem;
+}
+
+// -----------------------------------------------------------------
+// 9. POOL DE THREADS E EXECUÇÃO EM FAIXAS DE LINHAS
+// -----------------------------------------------------------------
+// Os passes de detecção são divididos em faixas de linhas do tamanho de
+// uma cache L2 e distribuídos a um pool de threads persistente (criado uma
+// vez e reaproveitado a cada imagem). Cada faixa grava sua contagem em uma
+// posição própria, e a soma é feita na ordem das faixas ao final: o
+// resultado é o mesmo para qualquer número de threads.
+
+#define BYTES_POR_FAIXA (256 * 1024)
+#define MAX_FAIXAS 1024
+
+/**
+ * @brief Relógio monotônico, em nanossegundos.
+ */
+DETECTOR_INTERNO double relogio_parede_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequencia, contador;
+    QueryPerformanceFrequency(&frequencia);
+    QueryPerformanceCounter(&contador);
+    return (double)contador.QuadPart * 1e9 / (double)frequencia.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Tempo de CPU consumido pela thread chamadora, em nanossegundos.
+ */
+DETECTOR_INTERNO double relogio_cpu_thread_ns(void) {
+#ifdef _WIN32
+    FILETIME criacao, fim, kernel, usuario;
+    GetThreadTimes(GetCurrentThread(), &criacao, &fim, &kernel, &usuario);
+    ULARGE_INTEGER k = {{kernel.dwLowDateTime, kernel.dwHighDateTime}};
+    ULARGE_INTEGER u = {{usuario.dwLowDateTime, usuario.dwHighDateTime}};
+    return (double)(k.QuadPart + u.QuadPart) * 100.0;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+#endif
+}
+
+// Executa a faixa 'indice' de um lote.
+typedef void (*TarefaFaixa)(void *contexto, int indice);
+
+typedef struct {
+    pthread_t *threads;
+    int num_threads;             // Threads auxiliares; a thread chamadora também trabalha
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_trabalho;
+    pthread_cond_t cond_fim;
+    unsigned geracao;            // Incrementada a cada lote publicado
+    bool encerrar;
+    // Lote atual
+    TarefaFaixa tarefa;
+    void *contexto;
+    int total_tarefas;
+    atomic_int proxima_tarefa;
+    int threads_ativas;          // Auxiliares que ainda não terminaram o lote atual
+    atomic_long cpu_auxiliares_ns; // CPU gasta pelas auxiliares nos lotes (métricas)
+} PoolThreads;
+
+/**
+ * @brief Retira faixas do lote atual até acabarem.
+ */
+static void pool_consumir_tarefas(PoolThreads *pool) {
+    for (;;) {
+        int indice = atomic_fetch_add(&pool->proxima_tarefa, 1);
+        if (indice >= pool->total_tarefas) break;
+        pool->tarefa(pool->contexto, indice);
+    }
+}
+
+static void *pool_laco_trabalhador(void *arg) {
+    PoolThreads *pool = (PoolThreads *)arg;
+    unsigned geracao_vista = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->encerrar && pool->geracao == geracao_vista) {
+            pthread_cond_wait(&pool->cond_trabalho, &pool->mutex);
+        }
+        if (pool->encerrar) break;
+        geracao_vista = pool->geracao;
+        pthread_mutex_unlock(&pool->mutex);
+
+        double cpu_inicio = relogio_cpu_thread_ns();
+        pool_consumir_tarefas(pool);
+        atomic_fetch_add(&pool->cpu_auxiliares_ns, (long)(relogio_cpu_thread_ns() - cpu_inicio));
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->threads_ativas == 0) pthread_cond_signal(&pool->cond_fim);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Número de processadores disponíveis.
+ */
+DETECTOR_INTERNO int numero_processadores(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/**
+ * @brief Cria um pool com 'num_threads' threads no total (incluindo a chamadora).
+ * @return NULL se num_threads <= 1 (execução serial) ou em caso de erro.
+ */
+DETECTOR_INTERNO PoolThreads *pool_criar(int num_threads) {
+    if (num_threads <= 1) return NULL;
+    PoolThreads *pool = (PoolThreads *)calloc(1, sizeof(PoolThreads));
+    if (!pool) return NULL;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond_trabalho, NULL);
+    pthread_cond_init(&pool->cond_fim, NULL);
+    atomic_init(&pool->proxima_tarefa, 0);
+    atomic_init(&pool->cpu_auxiliares_ns, 0);
+    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * (num_threads - 1));
+    if (!pool->threads) { // Sem memória: quem chama segue em série, como com pool NULL
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->cond_trabalho);
+        pthread_cond_destroy(&pool->cond_fim);
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < num_threads - 1; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, pool_laco_trabalhador, pool) != 0) break;
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+DETECTOR_INTERNO void pool_destruir(PoolThreads *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->encerrar = true;
+    pthread_cond_broadcast(&pool->cond_trabalho);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->num_threads; ++i) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond_trabalho);
+    pthread_cond_destroy(&pool->cond_fim);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * @brief Executa as tarefas 0..total-1 e espera todas terminarem.
+ * Com pool NULL, executa tudo na thread chamadora.
+ */
+DETECTOR_INTERNO void pool_executar(PoolThreads *pool, int total, TarefaFaixa tarefa, void *contexto) {
+    if (!pool || pool->num_threads == 0 || total <= 1) {
+        for (int i = 0; i < total; ++i) tarefa(contexto, i);
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->tarefa = tarefa;
+    pool->contexto = contexto;
+    pool->total_tarefas = total;
+    atomic_store(&pool->proxima_tarefa, 0);
+    pool->threads_ativas = pool->num_threads;
+    pool->geracao++;
+    pthread_cond_broadcast(&pool->cond_trabalho);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_consumir_tarefas(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->threads_ativas > 0) pthread_cond_wait(&pool->cond_fim, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * @brief Número de linhas por faixa para que cada faixa caiba na cache.
+ */
+DETECTOR_INTERNO int linhas_por_faixa(const Image *img) {
+    size_t bytes_linha = (size_t)img->width * img->channels + img->width / 8; // entrada + máscara de bits
+    int linhas = (int)(BYTES_POR_FAIXA / (bytes_linha ? bytes_linha : 1));
+    if (linhas < 1) linhas = 1;
+    // Limita o número de faixas para que as contagens caibam em um vetor fixo na pilha
+    int minimo = (img->height + MAX_FAIXAS - 1) / MAX_FAIXAS;
+    return linhas < minimo ? minimo : linhas;
+}
+
+// Método de classificação por pixel usado pelos passes de detecção.
+typedef struct {
+    const LimiaresFumaca *limiares;
+    const TabelaFumaca *tabela; // Se não for NULL, classifica pela tabela
+} Classificador;
+
+/**
+ * @brief Classifica uma linha com o método escolhido (motor fundido ou tabela).
+ */
+static inline long classificar_linha(const Classificador *c, const unsigned char *rgb, int canais, int n,
+                                     unsigned char *mascara) {
+    return c->tabela ? classificar_linha_tabela(c->tabela, rgb, canais, n, mascara)
+                     : classificar_linha_fundida(rgb, canais, n, c->limiares, mascara);
+}
+
+/**
+ * @brief Classifica uma linha e grava o resultado em bits (1 bit por pixel).
+ * Os bytes intermediários de cada bloco ficam só na pilha.
+ */
+DETECTOR_INTERNO long classificar_linha_bits(const Classificador *c, const unsigned char *rgb, int canais, int n, uint64_t *bits) {
+    unsigned char bloco[PIXELS_POR_BLOCO];
+    long contagem = 0;
+    for (int x0 = 0; x0 < n; x0 += PIXELS_POR_BLOCO) {
+        int tamanho = n - x0 < PIXELS_POR_BLOCO ? n - x0 : PIXELS_POR_BLOCO;
+        long parcial = classificar_linha(c, rgb + (size_t)x0 * canais, canais, tamanho, bloco);
+        if (parcial == 0) {
+            memset(bits + x0 / 64, 0, sizeof(uint64_t) * ((tamanho + 63) / 64));
+        } else {
+            empacotar_mascara_linha(bloco, tamanho, bits + x0 / 64);
+        }
+        contagem += parcial;
+    }
+    return contagem;
+}
+
+typedef struct {
+    const Classificador *classificador;
+    const Image *img;
+    MascaraBits *mascara;
+    int linhas_faixa;
+    long *contagens; // Uma posição por faixa
+} ContextoFaixas;
+
+static void tarefa_classificar_faixa(void *arg, int indice) {
+    ContextoFaixas *ctx = (ContextoFaixas *)arg;
+    const Image *img = ctx->img;
+    int y0 = indice * ctx->linhas_faixa;
+    int y1 = y0 + ctx->linhas_faixa < img->height ? y0 + ctx->linhas_faixa : img->height;
+    size_t bytes_linha = (size_t)img->width * img->channels;
+    long contagem = 0;
+    for (int y = y0; y < y1; ++y) {
+        const unsigned char *linha = img->data + y * bytes_linha;
+        if (ctx->mascara) {
+            contagem += classificar_linha_bits(ctx->classificador, linha, img->channels, img->width,
+                                               mascara_bits_linha(ctx->mascara, y));
+        } else {
+            contagem += classificar_linha(ctx->classificador, linha, img->channels, img->width, NULL);
+        }
+    }
+    ctx->contagens[indice] = contagem;
+}
+
+/**
+ * @brief Classifica a imagem inteira em faixas de linhas distribuídas ao pool.
+ * @param mascara Máscara de bits já criada com as dimensões da imagem, ou NULL (só conta).
+ * @return Número de pixels de fumaça (independe do número de threads).
+ */
+DETECTOR_INTERNO long classificar_imagem(PoolThreads *pool, const Classificador *classificador, const Image *img,
+                        MascaraBits *mascara) {
+    int linhas = linhas_por_faixa(img);
+    int faixas = (img->height + linhas - 1) / linhas;
+    long contagens[MAX_FAIXAS];
+    ContextoFaixas ctx = {classificador, img, mascara, linhas, contagens};
+    pool_executar(pool, faixas, tarefa_classificar_faixa, &ctx);
+
+    long total = 0;
+    for (int i = 0; i < faixas; ++i) total += contagens[i];
+    return total;
+}
+
+// -----------------------------------------------------------------
+// Modo "só alarme": decisão antecipada
+// -----------------------------------------------------------------
+// Quando só o veredito importa, a classificação para assim que a contagem
+// passa do limite (fumaça) ou quando nem todos os pixels restantes juntos
+// conseguiriam mais ultrapassá-lo (sem fumaça). O veredito é sempre o
+// mesmo da análise completa, para qualquer número de threads.
+
+typedef struct {
+    bool fumaca_detectada;
+    long contagem;           // Pixels de fumaça contados até a decisão
+    long pixels_analisados;
+} DecisaoAlarme;
+
+/**
+ * @brief Maior contagem que ainda NÃO dispara o alarme, com a mesma conta em
+ * float de avaliar_contagem_fumaca (100 * contagem / total > limiar).
+ */
+DETECTOR_INTERNO long limite_contagem_alarme(long total_pixels, float threshold_percent) {
+    if (threshold_percent < 0) return -1;
+    long c = (long)((double)threshold_percent * total_pixels / 100.0);
+    if (c > total_pixels) return total_pixels;
+    while (c >= 0 && 100.0f * c / total_pixels > threshold_percent) c--;
+    while (c < total_pixels && !(100.0f * (c + 1) / total_pixels > threshold_percent)) c++;
+    return c;
+}
+
+typedef struct {
+    const Classificador *classificador;
+    const Image *img;
+    int linhas_faixa;
+    long limite;
+    atomic_long contagem;
+    atomic_long restantes;   // Pixels ainda não classificados
+    atomic_long analisados;
+    atomic_bool decidido;
+} ContextoAlarme;
+
+static void tarefa_alarme_faixa(void *arg, int indice) {
+    ContextoAlarme *ctx = (ContextoAlarme *)arg;
+    const Image *img = ctx->img;
+    int y0 = indice * ctx->linhas_faixa;
+    int y1 = y0 + ctx->linhas_faixa < img->height ? y0 + ctx->linhas_faixa : img->height;
+    size_t bytes_linha = (size_t)img->width * img->channels;
+    for (int y = y0; y < y1; ++y) {
+        if (atomic_load_explicit(&ctx->decidido, memory_order_relaxed)) return;
+        long n = classificar_linha(ctx->classificador, img->data + y * bytes_linha, img->channels, img->width, NULL);
+        long contagem = atomic_fetch_add(&ctx->contagem, n) + n;
+        long restantes = atomic_fetch_sub(&ctx->restantes, img->width) - img->width;
+        atomic_fetch_add_explicit(&ctx->analisados, img->width, memory_order_relaxed);
+        if (contagem > ctx->limite) {
+            atomic_store(&ctx->decidido, true);
+        } else {
+            // 'restantes' já descontou as linhas que outras threads terminaram antes
+            // do nosso fetch_sub; a contagem delas só está garantida relendo-a agora
+            // (cada thread soma a contagem antes de descontar a linha).
+            contagem = atomic_load(&ctx->contagem);
+            if (contagem > ctx->limite || contagem + restantes <= ctx->limite) {
+                atomic_store(&ctx->decidido, true);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decide se há fumaça parando a classificação assim que o veredito estiver garantido.
+ */
+DETECTOR_INTERNO DecisaoAlarme decidir_alarme(PoolThreads *pool, const Classificador *classificador, const Image *img,
+                             float threshold_percent) {
+    long total = (long)img->width * img->height;
+    ContextoAlarme ctx;
+    ctx.classificador = classificador;
+    ctx.img = img;
+    ctx.linhas_faixa = linhas_por_faixa(img);
+    ctx.limite = limite_contagem_alarme(total, threshold_percent);
+    atomic_init(&ctx.contagem, 0);
+    atomic_init(&ctx.restantes, total);
+    atomic_init(&ctx.analisados, 0);
+    atomic_init(&ctx.decidido, ctx.limite < 0 || ctx.limite >= total);
+
+    int faixas = (img->height + ctx.linhas_faixa - 1) / ctx.linhas_faixa;
+    if (!atomic_load(&ctx.decidido)) pool_executar(pool, faixas, tarefa_alarme_faixa, &ctx);
+
+    DecisaoAlarme d;
+    d.contagem = atomic_load(&ctx.contagem);
+    d.pixels_analisados = atomic_load(&ctx.analisados);
+    d.fumaca_detectada = d.contagem > ctx.limite;
+    return d;
+}
+
+// -----------------------------------------------------------------
+// 10. ENTRADA NV12 (YUV 4:2:0) SEM CONVERSÃO PARA RGB
+// -----------------------------------------------------------------
+// Câmeras IP e decodificadores de hardware entregam NV12: um plano Y com um
+// byte por pixel, seguido de um plano UV entrelaçado com meia resolução nos
+// dois eixos (1,5 byte por pixel, contra 3 do RGB). Em vez de converter o
+// quadro para RGB, as regras viram uma tabela de 2^24 bits indexada por
+// (Y, U, V), construída aplicando a conversão BT.601 de faixa limitada
+// (Y 16-235) e as regras RGB e HSI a cada trio: o resultado é o mesmo de
+// converter o quadro para RGB com essa fórmula e classificá-lo.
+// Como a regra RGB exige os três canais claros, nenhum pixel abaixo de um Y
+// mínimo (calculado na construção) é fumaça: um filtro SIMD descarta de uma
+// vez cada grupo de 64 pixels do plano Y abaixo desse mínimo, sem ler o UV.
+
+typedef struct {
+    uint64_t *bits;  // Bit (y << 16) | (u << 8) | v ligado = fumaça
+    int y_minimo;    // Menor Y com algum trio de fumaça (256 = nenhum)
+} TabelaYuv;
+
+/**
+ * @brief Conversão YUV -> RGB da BT.601 em faixa limitada (ponto fixo de 8 bits).
+ */
+static inline void yuv_para_rgb(int y, int u, int v, unsigned char rgb[3]) {
+    int c = 298 * (y - 16) + 128, d = u - 128, e = v - 128;
+    int r = (c + 409 * e) >> 8, g = (c - 100 * d - 208 * e) >> 8, b = (c + 516 * d) >> 8;
+    rgb[0] = (unsigned char)(r < 0 ? 0 : (r > 255 ? 255 : r));
+    rgb[1] = (unsigned char)(g < 0 ? 0 : (g > 255 ? 255 : g));
+    rgb[2] = (unsigned char)(b < 0 ? 0 : (b > 255 ? 255 : b));
+}
+
+/**
+ * @brief Constrói a tabela YUV aplicando as regras a todos os 2^24 trios convertidos.
+ */
+DETECTOR_INTERNO bool tabela_yuv_construir(TabelaYuv *tabela, const LimiaresFumaca *lim) {
+    tabela->bits = (uint64_t *)calloc(TABELA_FUMACA_PALAVRAS, sizeof(uint64_t));
+    tabela->y_minimo = 256;
+    if (!tabela->bits) return false;
+    for (int y = 255; y >= 0; --y) {
+        for (int u = 0; u < 256; ++u) {
+            for (int v = 0; v < 256; ++v) {
+                unsigned char rgb[3];
+                yuv_para_rgb(y, u, v, rgb);
+                if (regra_rgb(rgb[0], rgb[1], rgb[2], lim) && regra_hsi(rgb[0], rgb[1], rgb[2], lim)) {
+                    uint32_t i = ((uint32_t)y << 16) | ((uint32_t)u << 8) | (uint32_t)v;
+                    tabela->bits[i >> 6] |= (uint64_t)1 << (i & 63);
+                    tabela->y_minimo = y;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+DETECTOR_INTERNO void tabela_yuv_liberar(TabelaYuv *tabela) {
+    free(tabela->bits);
+    tabela->bits = NULL;
+}
+
+/**
+ * @brief Verifica se algum dos 'n' (<= 64) bytes de Y atinge 'y_minimo'.
+ * SSE2: max(v, mínimo) == v só nos bytes >= mínimo; 16 bytes por comparação.
+ */
+static inline bool algum_y_candidato(const unsigned char *y, int n, int y_minimo) {
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i minimo = _mm_set1_epi8((char)y_minimo);
+    for (; x + 16 <= n; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(y + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, minimo), v)) != 0) return true;
+    }
+#endif
+    for (; x < n; ++x) {
+        if (y[x] >= y_minimo) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Classifica uma linha NV12 de 'n' pixels: 'y' é a linha do plano Y e 'uv' a
+ * linha do plano UV que a cobre (y / 2). Se 'bits' for NULL, apenas conta.
+ * @return Número de pixels de fumaça na linha.
+ */
+DETECTOR_INTERNO long classificar_linha_nv12(const TabelaYuv *tabela, const unsigned char *y, const unsigned char *uv, int n,
+                            uint64_t *bits) {
+    long contagem = 0;
+    for (int x0 = 0; x0 < n; x0 += 64) {
+        int fim = n - x0 < 64 ? n - x0 : 64;
+        uint64_t palavra = 0;
+        if (tabela->y_minimo < 256 && algum_y_candidato(y + x0, fim, tabela->y_minimo)) {
+            for (int k = 0; k < fim; ++k) {
+                int x = x0 + k;
+                const unsigned char *c = uv + (x & ~1);
+                uint32_t i = ((uint32_t)y[x] << 16) | ((uint32_t)c[0] << 8) | c[1];
+                palavra |= ((tabela->bits[i >> 6] >> (i & 63)) & 1) << k;
+            }
+            contagem += __builtin_popcountll(palavra);
+        }
+        if (bits) bits[x0 / 64] = palavra;
+    }
+    return contagem;
+}
+
+// Quadro NV12 com planos em posições e strides quaisquer.
+typedef struct {
+    const unsigned char *y;
+    size_t stride_y;
+    const unsigned char *uv;
+    size_t stride_uv;
+    int width;
+    int height;
+} QuadroNv12;
+
+typedef struct {
+    const TabelaYuv *tabela;
+    const QuadroNv12 *quadro;
+    MascaraBits *mascara;
+    int linhas_faixa;
+    long *contagens; // Uma posição por faixa
+} ContextoNv12;
+
+static void tarefa_classificar_faixa_nv12(void *arg, int indice) {
+    ContextoNv12 *ctx = (ContextoNv12 *)arg;
+    const QuadroNv12 *q = ctx->quadro;
+    int y0 = indice * ctx->linhas_faixa;
+    int y1 = y0 + ctx->linhas_faixa < q->height ? y0 + ctx->linhas_faixa : q->height;
+    long contagem = 0;
+    for (int y = y0; y < y1; ++y) {
+        contagem += classificar_linha_nv12(ctx->tabela, q->y + (size_t)y * q->stride_y,
+                                           q->uv + (size_t)(y / 2) * q->stride_uv, q->width,
+                                           ctx->mascara ? mascara_bits_linha(ctx->mascara, y) : NULL);
+    }
+    ctx->contagens[indice] = contagem;
+}
+
+/**
+ * @brief Classifica um quadro NV12 inteiro em faixas de linhas distribuídas ao pool.
+ * @param mascara Máscara de bits já criada com as dimensões do quadro, ou NULL (só conta).
+ * @return Número de pixels de fumaça (independe do número de threads).
+ */
+DETECTOR_INTERNO long classificar_nv12(PoolThreads *pool, const TabelaYuv *tabela, const QuadroNv12 *quadro, MascaraBits *mascara) {
+    Image dimensoes = {NULL, quadro->width, quadro->height, 2}; // ~1,5 byte por pixel
+    int linhas = linhas_por_faixa(&dimensoes);
+    int faixas = (quadro->height + linhas - 1) / linhas;
+    long contagens[MAX_FAIXAS];
+    ContextoNv12 ctx = {tabela, quadro, mascara, linhas, contagens};
+    pool_executar(pool, faixas, tarefa_classificar_faixa_nv12, &ctx);
+
+    long total = 0;
+    for (int i = 0; i < faixas; ++i) total += contagens[i];
+    return total;
+}
+
+/**
+ * @brief Tamanho em bytes de um quadro NV12 contíguo (plano Y seguido do plano UV).
+ */
+DETECTOR_INTERNO size_t tamanho_quadro_nv12(int width, int height) {
+    return (size_t)width * height + (size_t)2 * ((width + 1) / 2) * ((height + 1) / 2);
+}
+
+// -----------------------------------------------------------------
+// 11. MÉTRICAS POR ETAPA (--metricas)
+// -----------------------------------------------------------------
+// Com --metricas, cada imagem gera um objeto JSON (uma linha) com o tempo de
+// parede e de CPU de cada etapa, os bytes lidos e gravados, os pixels
+// classificados, os pixels de fumaça de cada regra e o pico de memória
+// residente do processo. O tempo de CPU de uma etapa soma a thread que a
+// executa e as threads auxiliares do pool (no lote, só a classificação usa
+// o pool). Sem --metricas nada disto é medido.
+
+typedef enum {
+    ETAPA_TRIAGEM,
+    ETAPA_DECODIFICAR,
+    ETAPA_SEGMENTAR_RGB,
+    ETAPA_SEGMENTAR_HSI,
+    ETAPA_COMBINAR,
+    ETAPA_CLASSIFICAR,
+    ETAPA_LIMPEZA,
+    ETAPA_REGIOES,
+    ETAPA_CONTAGEM_REGRAS,   // Só existe com --metricas: conta cada regra em separado
+    ETAPA_GRAVAR,
+    NUM_ETAPAS_METRICAS
+} EtapaMetricas;
+
+static const char *NOMES_ETAPAS_METRICAS[NUM_ETAPAS_METRICAS] = {
+    "triagem", "decodificar", "segmentar_rgb", "segmentar_hsi", "combinar",
+    "classificar", "limpeza", "regioes", "contagem_regras", "gravar",
+};
+
+typedef struct {
+    double parede_ns;
+    double cpu_ns;
+    bool executada;
+} TempoEtapa;
+
+typedef struct {
+    TempoEtapa etapas[NUM_ETAPAS_METRICAS];
+    long bytes_lidos;
+    long bytes_gravados;
+    long pixels_classificados;
+    long fumaca_rgb;   // Pixels aprovados por cada regra; -1 = não medido
+    long fumaca_hsi;
+    long fumaca_final;
+} MetricasImagem;
+
+// Instante de início de uma etapa.
+typedef struct {
+    double parede_ns;
+    double cpu_ns;
+    long cpu_pool_ns;
+} MarcaTempo;
+
+DETECTOR_INTERNO void metricas_iniciar(MetricasImagem *m) {
+    memset(m, 0, sizeof(*m));
+    m->fumaca_rgb = m->fumaca_hsi = m->fumaca_final = -1;
+}
+
+/**
+ * @brief Marca o início de uma etapa (não faz nada se 'm' for NULL).
+ */
+DETECTOR_INTERNO MarcaTempo metricas_marcar(const MetricasImagem *m, PoolThreads *pool) {
+    MarcaTempo t = {0.0, 0.0, 0};
+    if (!m) return t;
+    t.parede_ns = relogio_parede_ns();
+    t.cpu_ns = relogio_cpu_thread_ns();
+    t.cpu_pool_ns = pool ? atomic_load(&pool->cpu_auxiliares_ns) : 0;
+    return t;
+}
+
+/**
+ * @brief Soma à etapa 'e' o tempo decorrido desde 'inicio' (não faz nada se 'm' for NULL).
+ */
+DETECTOR_INTERNO void metricas_registrar(MetricasImagem *m, EtapaMetricas e, const MarcaTempo *inicio, PoolThreads *pool) {
+    if (!m) return;
+    TempoEtapa *t = &m->etapas[e];
+    t->parede_ns += relogio_parede_ns() - inicio->parede_ns;
+    t->cpu_ns += relogio_cpu_thread_ns() - inicio->cpu_ns;
+    if (pool) t->cpu_ns += (double)(atomic_load(&pool->cpu_auxiliares_ns) - inicio->cpu_pool_ns);
+    t->executada = true;
+}
+
+typedef struct {
+    const Image *img;
+    const LimiaresFumaca *limiares;
+    int linhas_faixa;
+    long *contagens; // Duas posições por faixa: RGB e HSI
+} ContextoRegras;
+
+static void tarefa_contar_regras_faixa(void *arg, int indice) {
+    ContextoRegras *ctx = (ContextoRegras *)arg;
+    const Image *img = ctx->img;
+    int y0 = indice * ctx->linhas_faixa;
+    int y1 = y0 + ctx->linhas_faixa < img->height ? y0 + ctx->linhas_faixa : img->height;
+    size_t bytes_linha = (size_t)img->width * img->channels;
+    unsigned char bloco[PIXELS_POR_BLOCO];
+    long rgb = 0, hsi = 0;
+    for (int y = y0; y < y1; ++y) {
+        const unsigned char *linha = img->data + y * bytes_linha;
+        for (int x0 = 0; x0 < img->width; x0 += PIXELS_POR_BLOCO) {
+            int n = img->width - x0 < PIXELS_POR_BLOCO ? img->width - x0 : PIXELS_POR_BLOCO;
+            const unsigned char *p = linha + (size_t)x0 * img->channels;
+            if (img->channels == 3) {
+                rgb += kernel_regra_rgb(p, n, ctx->limiares, bloco);
+            } else {
+                for (int x = 0; x < n; ++x) {
+                    const unsigned char *q = p + (size_t)x * img->channels;
+                    rgb += regra_rgb(q[0], q[1], q[2], ctx->limiares);
+                }
+            }
+            for (int x = 0; x < n; ++x) {
+                const unsigned char *q = p + (size_t)x * img->channels;
+                hsi += regra_hsi(q[0], q[1], q[2], ctx->limiares);
+            }
+        }
+    }
+    ctx->contagens[2 * indice] = rgb;
+    ctx->contagens[2 * indice + 1] = hsi;
+}
+
+/**
+ * @brief Conta, em faixas paralelas, os pixels aprovados por cada regra em separado
+ * (o motor fundido só avalia a regra HSI nos candidatos da RGB).
+ */
+DETECTOR_INTERNO void contar_por_regra(PoolThreads *pool, const Image *img, const LimiaresFumaca *lim, long *rgb, long *hsi) {
+    int linhas = linhas_por_faixa(img);
+    int faixas = (img->height + linhas - 1) / linhas;
+    long contagens[2 * MAX_FAIXAS];
+    ContextoRegras ctx = {img, lim, linhas, contagens};
+    pool_executar(pool, faixas, tarefa_contar_regras_faixa, &ctx);
+    *rgb = *hsi = 0;
+    for (int i = 0; i < faixas; ++i) {
+        *rgb += contagens[2 * i];
+        *hsi += contagens[2 * i + 1];
+    }
+}
+
+/**
+ * @brief Tamanho do arquivo em bytes, ou 0 se não existir.
+ */
+DETECTOR_INTERNO long tamanho_arquivo(const char *caminho) {
+    struct stat st;
+    return stat(caminho, &st) == 0 ? (long)st.st_size : 0;
+}
+
+/**
+ * @brief Pico de memória residente do processo até agora, em KB (-1 se indisponível).
+ */
+DETECTOR_INTERNO long pico_rss_kb(void) {
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage uso;
+    if (getrusage(RUSAGE_SELF, &uso) != 0) return -1;
+#ifdef __APPLE__
+    return uso.ru_maxrss / 1024; // Em bytes no macOS
+#else
+    return uso.ru_maxrss;
+#endif
+#endif
+}
+
+static void escrever_string_json(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void escrever_contagem_json(FILE *f, const char *nome, long valor) {
+    if (valor < 0) fprintf(f, "\"%s\":null", nome);
+    else fprintf(f, "\"%s\":%ld", nome, valor);
+}
+
+/**
+ * @brief Escreve as métricas da imagem como um objeto JSON em uma linha.
+ * Só aparecem as etapas que foram executadas.
+ */
+DETECTOR_INTERNO void metricas_escrever_json(FILE *f, const char *imagem, int largura, int altura, const MetricasImagem *m) {
+    fputs("{\"imagem\":", f);
+    escrever_string_json(f, imagem);
+    fprintf(f, ",\"largura\":%d,\"altura\":%d,\"bytes_lidos\":%ld,\"bytes_gravados\":%ld,"
+               "\"pixels_classificados\":%ld,\"pixels_fumaca\":{",
+            largura, altura, m->bytes_lidos, m->bytes_gravados, m->pixels_classificados);
+    escrever_contagem_json(f, "rgb", m->fumaca_rgb);
+    fputc(',', f);
+    escrever_contagem_json(f, "hsi", m->fumaca_hsi);
+    fputc(',', f);
+    escrever_contagem_json(f, "final", m->fumaca_final);
+    fputs("},\"etapas\":{", f);
+    bool primeira = true;
+    for (int e = 0; e < NUM_ETAPAS_METRICAS; ++e) {
+        if (!m->etapas[e].executada) continue;
+        fprintf(f, "%s\"%s\":{\"parede_ms\":%.3f,\"cpu_ms\":%.3f}", primeira ? "" : ",", NOMES_ETAPAS_METRICAS[e],
+                m->etapas[e].parede_ns / 1e6, m->etapas[e].cpu_ns / 1e6);
+        primeira = false;
+    }
+    long rss = pico_rss_kb();
+    fputs("},", f);
+    escrever_contagem_json(f, "pico_rss_kb", rss);
+    fputs("}\n", f);
+    fflush(f);
+}
+
+// -----------------------------------------------------------------
+// 12. COMPONENTES CONEXOS (REGIÕES DE FUMAÇA)
+// -----------------------------------------------------------------
+// Pixels brancos espalhados (neve, reflexos, paredes) somam a mesma
+// porcentagem que uma pluma inteira. Para diferenciá-los, a máscara final é
+// dividida em regiões conexas (vizinhança-8) e o alarme pode ser decidido pela
+// maior região. A rotulagem trabalha sobre corridas (sequências de bits 1 numa
+// linha), lidas direto das palavras da máscara de bits, com union-find em duas
+// passadas: cada faixa de linhas une suas corridas em paralelo, e depois as
+// fronteiras entre faixas são unidas e as estatísticas acumuladas em série.
+
+#define LINHAS_POR_FAIXA_REGIOES 64
+
+// Corrida de pixels de fumaça [x0, x1) na linha y.
+typedef struct {
+    int x0, x1;
+    int y;
+} Corrida;
+
+typedef struct {
+    Corrida *corridas;
+    int *pai;                // Union-find com índices locais à faixa
+    int quantidade;
+    int capacidade;
+    int inicio_ultima_linha; // Índice da primeira corrida da última linha da faixa
+    bool falha;              // Faltou memória para as corridas desta faixa
+} FaixaCorridas;
+
+typedef struct {
+    long area;
+    int x_min, y_min, x_max, y_max; // Caixa envolvente (inclusiva)
+    float centroide_x, centroide_y;
+} RegiaoFumaca;
+
+typedef struct {
+    RegiaoFumaca *regioes;   // Em ordem decrescente de área
+    int quantidade;
+    bool falha;              // Faltou memória: nenhuma região (regioes == NULL)
+} RegioesFumaca;
+
+static int uf_raiz(int *pai, int i) {
+    while (pai[i] != i) {
+        pai[i] = pai[pai[i]]; // Compressão por divisão do caminho
+        i = pai[i];
+    }
+    return i;
+}
+
+// A raiz é sempre o menor índice: o resultado não depende da ordem das uniões.
+static void uf_unir(int *pai, int a, int b) {
+    a = uf_raiz(pai, a);
+    b = uf_raiz(pai, b);
+    if (a < b) pai[b] = a;
+    else if (b < a) pai[a] = b;
+}
+
+/**
+ * @brief Posição do próximo bit igual a 'valor' a partir de x (ou 'limite' se não houver).
+ */
+static int proximo_bit(const uint64_t *bits, int x, int limite, bool valor) {
+    while (x < limite) {
+        uint64_t palavra = valor ? bits[x / 64] : ~bits[x / 64];
+        palavra &= ~0ULL << (x % 64);
+        if (palavra) {
+            int pos = (x & ~63) + __builtin_ctzll(palavra);
+            return pos < limite ? pos : limite;
+        }
+        x = (x & ~63) + 64;
+    }
+    return limite;
+}
+
+/**
+ * @brief Une as corridas sobrepostas (vizinhança-8) de duas linhas consecutivas.
+ * [a0, a1) são as corridas da linha de cima e [b0, b1) as da linha de baixo.
+ */
+static void unir_linhas(const Corrida *corridas, int *pai, int a0, int a1, int b0, int b1) {
+    int i = a0, j = b0;
+    while (i < a1 && j < b1) {
+        if (corridas[i].x0 <= corridas[j].x1 && corridas[j].x0 <= corridas[i].x1) uf_unir(pai, i, j);
+        if (corridas[i].x1 < corridas[j].x1) ++i;
+        else ++j;
+    }
+}
+
+typedef struct {
+    const MascaraBits *mascara;
+    FaixaCorridas *faixas;
+} ContextoRegioes;
+
+static void tarefa_rotular_faixa(void *arg, int indice) {
+    ContextoRegioes *ctx = (ContextoRegioes *)arg;
+    const MascaraBits *m = ctx->mascara;
+    FaixaCorridas *f = &ctx->faixas[indice];
+    int y0 = indice * LINHAS_POR_FAIXA_REGIOES;
+    int y1 = y0 + LINHAS_POR_FAIXA_REGIOES < m->height ? y0 + LINHAS_POR_FAIXA_REGIOES : m->height;
+    int inicio_anterior = 0, fim_anterior = 0; // Corridas da linha anterior
+    for (int y = y0; y < y1; ++y) {
+        const uint64_t *bits = mascara_bits_linha(m, y);
+        int inicio = f->quantidade;
+        int x = proximo_bit(bits, 0, m->width, true);
+        while (x < m->width) {
+            int fim = proximo_bit(bits, x, m->width, false);
+            if (f->quantidade == f->capacidade) {
+                // Em temporários: numa falha os blocos antigos continuam em f e são devolvidos
+                int capacidade = f->capacidade ? f->capacidade * 2 : 256;
+                Corrida *corridas = (Corrida *)reserva_realocar(f->corridas, sizeof(Corrida) * capacidade);
+                if (corridas) f->corridas = corridas;
+                int *pai = corridas ? (int *)reserva_realocar(f->pai, sizeof(int) * capacidade) : NULL;
+                if (!pai) {
+                    f->falha = true;
+                    return;
+                }
+                f->pai = pai;
+                f->capacidade = capacidade;
+            }
+            f->corridas[f->quantidade] = (Corrida){x, fim, y};
+            f->pai[f->quantidade] = f->quantidade;
+            f->quantidade++;
+            x = proximo_bit(bits, fim, m->width, true);
+        }
+        if (y > y0) unir_linhas(f->corridas, f->pai, inicio_anterior, fim_anterior, inicio, f->quantidade);
+        inicio_anterior = inicio;
+        fim_anterior = f->quantidade;
+    }
+    f->inicio_ultima_linha = inicio_anterior;
+}
+
+static int comparar_regioes(const void *a, const void *b) {
+    const RegiaoFumaca *ra = (const RegiaoFumaca *)a, *rb = (const RegiaoFumaca *)b;
+    if (ra->area != rb->area) return ra->area > rb->area ? -1 : 1;
+    if (ra->y_min != rb->y_min) return ra->y_min - rb->y_min;
+    return ra->x_min - rb->x_min;
+}
+
+/**
+ * @brief Rotula as regiões conexas (vizinhança-8) da máscara e calcula área,
+ * caixa envolvente e centroide de cada uma. O resultado não depende do número
+ * de threads. Se faltar memória, devolve nenhuma região com 'falha' marcada.
+ * Libere com regioes_liberar.
+ */
+DETECTOR_INTERNO RegioesFumaca rotular_regioes(PoolThreads *pool, const MascaraBits *mascara) {
+    RegioesFumaca r = {NULL, 0, true};
+    int num_faixas = (mascara->height + LINHAS_POR_FAIXA_REGIOES - 1) / LINHAS_POR_FAIXA_REGIOES;
+    FaixaCorridas *faixas = (FaixaCorridas *)reserva_obter_zerado(sizeof(FaixaCorridas) * (num_faixas > 0 ? num_faixas : 1));
+    if (!faixas) return r;
+    ContextoRegioes ctx = {mascara, faixas};
+    pool_executar(pool, num_faixas, tarefa_rotular_faixa, &ctx);
+
+    // Junta as florestas das faixas em índices globais
+    bool ok = true;
+    int total = 0;
+    for (int b = 0; b < num_faixas; ++b) {
+        ok = ok && !faixas[b].falha;
+        total += faixas[b].quantidade;
+    }
+    int *inicio = (int *)reserva_obter(sizeof(int) * (num_faixas > 0 ? num_faixas : 1));
+    Corrida *corridas = (Corrida *)reserva_obter(sizeof(Corrida) * (total > 0 ? total : 1));
+    int *pai = (int *)reserva_obter(sizeof(int) * (total > 0 ? total : 1));
+    ok = ok && inicio && corridas && pai;
+    for (int b = 0; ok && b < num_faixas; ++b) {
+        FaixaCorridas *f = &faixas[b];
+        inicio[b] = b > 0 ? inicio[b - 1] + faixas[b - 1].quantidade : 0;
+        for (int i = 0; i < f->quantidade; ++i) {
+            corridas[inicio[b] + i] = f->corridas[i];
+            pai[inicio[b] + i] = inicio[b] + f->pai[i];
+        }
+    }
+    // Fronteiras: última linha de cada faixa com a primeira linha da seguinte
+    for (int b = 1; ok && b < num_faixas; ++b) {
+        int a0 = inicio[b - 1] + faixas[b - 1].inicio_ultima_linha, a1 = inicio[b];
+        int y = b * LINHAS_POR_FAIXA_REGIOES;
+        if (a0 == a1 || corridas[a0].y != y - 1) continue;
+        int b0 = inicio[b], b1 = b0;
+        while (b1 < inicio[b] + faixas[b].quantidade && corridas[b1].y == y) ++b1;
+        unir_linhas(corridas, pai, a0, a1, b0, b1);
+    }
+    for (int b = 0; b < num_faixas; ++b) {
+        reserva_devolver(faixas[b].corridas);
+        reserva_devolver(faixas[b].pai);
+    }
+    reserva_devolver(faixas);
+    reserva_devolver(inicio);
+
+    // Acumula as estatísticas por raiz
+    int *regiao_da_raiz = ok ? (int *)reserva_obter(sizeof(int) * (total > 0 ? total : 1)) : NULL;
+    double *somas = ok ? (double *)reserva_obter(sizeof(double) * 2 * (total > 0 ? total : 1)) : NULL;
+    r.regioes = ok ? (RegiaoFumaca *)reserva_obter(sizeof(RegiaoFumaca) * (total > 0 ? total : 1)) : NULL;
+    if (!regiao_da_raiz || !somas || !r.regioes) {
+        reserva_devolver(r.regioes);
+        r.regioes = NULL;
+        total = 0;
+    } else {
+        r.falha = false;
+    }
+    for (int i = 0; i < total; ++i) {
+        int raiz = uf_raiz(pai, i);
+        const Corrida *c = &corridas[i];
+        long comprimento = c->x1 - c->x0;
+        RegiaoFumaca *reg;
+        if (raiz == i) { // Raízes são o menor índice do grupo: aparecem antes dos membros
+            regiao_da_raiz[i] = r.quantidade;
+            reg = &r.regioes[r.quantidade];
+            *reg = (RegiaoFumaca){0, c->x0, c->y, c->x1 - 1, c->y, 0.0f, 0.0f};
+            somas[2 * r.quantidade] = somas[2 * r.quantidade + 1] = 0.0;
+            r.quantidade++;
+        }
+        int k = regiao_da_raiz[raiz];
+        reg = &r.regioes[k];
+        reg->area += comprimento;
+        if (c->x0 < reg->x_min) reg->x_min = c->x0;
+        if (c->x1 - 1 > reg->x_max) reg->x_max = c->x1 - 1;
+        if (c->y < reg->y_min) reg->y_min = c->y;
+        if (c->y > reg->y_max) reg->y_max = c->y;
+        somas[2 * k] += (double)(c->x0 + c->x1 - 1) * comprimento / 2.0; // Soma de x0..x1-1
+        somas[2 * k + 1] += (double)c->y * comprimento;
+    }
+    for (int k = 0; k < r.quantidade; ++k) {
+        r.regioes[k].centroide_x = (float)(somas[2 * k] / r.regioes[k].area);
+        r.regioes[k].centroide_y = (float)(somas[2 * k + 1] / r.regioes[k].area);
+    }
+    if (r.quantidade > 1) qsort(r.regioes, r.quantidade, sizeof(RegiaoFumaca), comparar_regioes);
+
+    reserva_devolver(somas);
+    reserva_devolver(regiao_da_raiz);
+    reserva_devolver(pai);
+    reserva_devolver(corridas);
+    return r;
+}
+
+DETECTOR_INTERNO void regioes_liberar(RegioesFumaca *r) {
+    reserva_devolver(r->regioes);
+    r->regioes = NULL;
+    r->quantidade = 0;
+    r->falha = false;
+}
+
+/**
+ * @brief Imprime as maiores regiões e decide o alarme pela maior delas.
+ * @return true se a maior região cobrir mais que 'deteccao_threshold' por cento da imagem.
+ */
+DETECTOR_INTERNO bool avaliar_regioes(const RegioesFumaca *r, long total_pixels, float deteccao_threshold) {
+    printf("Regiões conexas: %d\n", r->quantidade);
+    for (int k = 0; k < r->quantidade && k < 5; ++k) {
+        const RegiaoFumaca *reg = &r->regioes[k];
+        printf("  #%d: %ld pixels (%.4f%%), caixa (%d,%d)-(%d,%d), centroide (%.1f, %.1f)\n", k + 1, reg->area,
+               100.0f * reg->area / total_pixels, reg->x_min, reg->y_min, reg->x_max, reg->y_max,
+               reg->centroide_x, reg->centroide_y);
+    }
+    float maior = r->quantidade > 0 ? 100.0f * r->regioes[0].area / total_pixels : 0.0f;
+    printf("Análise: a maior região cobre %.4f%% da imagem.\n", maior);
+    return maior > deteccao_threshold;
+}
+
+// -----------------------------------------------------------------
+// 13. MORFOLOGIA MATEMÁTICA (EROSÃO, DILATAÇÃO, ABERTURA, FECHAMENTO)
+// -----------------------------------------------------------------
+// Limpa o ruído da máscara (pixels isolados) com elementos estruturantes
+// retangulares L x A, ancorados no centro (L/2, A/2). Pixels fora da imagem não
+// participam: equivalem a 1 na erosão e a 0 na dilatação. A dilatação é o
+// complemento da erosão do complemento, então só a erosão é implementada.
+//
+// O retângulo é separável: uma passada horizontal e uma vertical. A vertical usa
+// van Herk/Gil-Werman (vHGW): as linhas são agrupadas em blocos de A linhas, com
+// um mínimo acumulado para frente (g) e outro para trás (h) dentro de cada bloco,
+// e o mínimo de qualquer janela de A linhas é min(h[y], g[y + A - 1]). São 3
+// operações por pixel para qualquer A, aplicadas a trechos de linha (16 bytes por
+// instrução SSE2 nas máscaras de bytes, 64 pixels por palavra nas de bits).
+// Na horizontal, as máscaras de bytes usam o mesmo vHGW ao longo da linha, sobre
+// 16 linhas intercaladas de uma vez (um mínimo SSE2 por passo); nas de bits o
+// E de L bits vizinhos sai de deslocamentos com duplicação (janelas de 1, 2, 4...
+// bits), em O(log L) operações por palavra de 64 pixels.
+
+typedef enum {
+    MORF_EROSAO,
+    MORF_DILATACAO,
+    MORF_ABERTURA,   // Erosão seguida de dilatação: remove ruído menor que o elemento
+    MORF_FECHAMENTO  // Dilatação seguida de erosão: fecha buracos menores que o elemento
+} OperacaoMorfologica;
+
+// ---- Máscaras de bytes (0/255) ----
+
+// Mínimo elemento a elemento de duas linhas de bytes.
+static void minimo_linhas(const unsigned char *a, const unsigned char *b, unsigned char *saida, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(saida + i), _mm_min_epu8(va, vb));
+    }
+#endif
+    for (; i < n; ++i) saida[i] = a[i] < b[i] ? a[i] : b[i];
+}
+
+static void complementar_bytes(unsigned char *dados, size_t n) {
+    for (size_t i = 0; i < n; ++i) dados[i] = (unsigned char)(255 - dados[i]);
+}
+
+// Temporários por chamada da passada vertical: ela percorre a imagem em faixas de
+// colunas, com g e h de cada faixa cabendo nesse total (na cache L2), em vez de
+// duas cópias do quadro.
+#define BYTES_TEMPORARIOS_MORFOLOGIA (1024 * 1024)
+
+/**
+ * @brief Largura (em elementos de 'tamanho' bytes, múltipla de 'alinhamento') das faixas
+ * de colunas da passada vertical, para 'linhas' linhas de g e de h.
+ */
+static int colunas_por_faixa(int linhas, int largura, size_t tamanho, int alinhamento) {
+    size_t colunas = BYTES_TEMPORARIOS_MORFOLOGIA / (2 * (size_t)linhas * tamanho);
+    colunas -= colunas % alinhamento;
+    if (colunas < (size_t)alinhamento) colunas = alinhamento;
+    return colunas < (size_t)largura ? (int)colunas : largura;
+}
+
+// Mínimo de 16 bytes (um registrador SSE2): um passo do vHGW horizontal intercalado.
+static inline void minimo_16(const unsigned char *a, const unsigned char *b, unsigned char *saida) {
+#ifdef __SSE2__
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    _mm_storeu_si128((__m128i *)saida, _mm_min_epu8(va, vb));
+#else
+    for (int k = 0; k < 16; ++k) saida[k] = a[k] < b[k] ? a[k] : b[k];
+#endif
+}
+
+#ifdef __SSE2__
+// Transpõe 16x16 bytes: quatro rodadas intercalando os registradores i e i + 8.
+static void transpor_16x16(__m128i v[16]) {
+    for (int rodada = 0; rodada < 4; ++rodada) {
+        __m128i t[16];
+        for (int i = 0; i < 8; ++i) {
+            t[2 * i] = _mm_unpacklo_epi8(v[i], v[i + 8]);
+            t[2 * i + 1] = _mm_unpackhi_epi8(v[i], v[i + 8]);
+        }
+        memcpy(v, t, sizeof(t));
+    }
+}
+#endif
+
+/**
+ * @brief Intercala 16 linhas de 'w' bytes: saida[16 * x + r] = linhas[r][x].
+ */
+static void intercalar_linhas(unsigned char *const linhas[16], int w, unsigned char *saida) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 16 <= w; x += 16) {
+        __m128i v[16];
+        for (int r = 0; r < 16; ++r) v[r] = _mm_loadu_si128((const __m128i *)(linhas[r] + x));
+        transpor_16x16(v);
+        for (int c = 0; c < 16; ++c) _mm_storeu_si128((__m128i *)(saida + 16 * (size_t)(x + c)), v[c]);
+    }
+#endif
+    for (; x < w; ++x) {
+        for (int r = 0; r < 16; ++r) saida[16 * (size_t)x + r] = linhas[r][x];
+    }
+}
+
+/**
+ * @brief Inverso de intercalar_linhas: linhas[r][x] = entrada[16 * x + r].
+ */
+static void desintercalar_linhas(const unsigned char *entrada, int w, unsigned char *const linhas[16]) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 16 <= w; x += 16) {
+        __m128i v[16];
+        for (int c = 0; c < 16; ++c) v[c] = _mm_loadu_si128((const __m128i *)(entrada + 16 * (size_t)(x + c)));
+        transpor_16x16(v);
+        for (int r = 0; r < 16; ++r) _mm_storeu_si128((__m128i *)(linhas[r] + x), v[r]);
+    }
+#endif
+    for (; x < w; ++x) {
+        for (int r = 0; r < 16; ++r) linhas[r][x] = entrada[16 * (size_t)x + r];
+    }
+}
+
+/**
+ * @brief Bytes de temporários de erodir_bytes (o maior entre as duas passadas, que os reaproveitam).
+ */
+static size_t temporarios_erosao_bytes(const Image *m, int largura_el, int altura_el) {
+    size_t horizontal = 0, vertical = 0;
+    if (largura_el > 1) horizontal = 3 * (size_t)(m->width + largura_el - 1) * 16 + m->width;
+    if (altura_el > 1) {
+        int n = m->height + altura_el - 1;
+        vertical = (2 * (size_t)n + 1) * colunas_por_faixa(n, m->width, 1, 16);
+    }
+    return horizontal > vertical ? horizontal : vertical;
+}
+
+/**
+ * @brief Erosão de uma máscara de bytes (1 canal) por um retângulo largura x altura, no lugar.
+ * 'temp' tem temporarios_erosao_bytes bytes.
+ */
+static void erodir_bytes(Image *m, int largura_el, int altura_el, unsigned char *temp) {
+    int w = m->width, h = m->height;
+    if (w == 0 || h == 0) return;
+    // Horizontal: vHGW ao longo das linhas, 16 linhas por vez. As linhas são
+    // intercaladas (transpostas em blocos 16x16), de modo que cada posição da
+    // linha acolchoada por 255 é um registrador com o pixel das 16 linhas, e cada
+    // passo do vHGW é um único mínimo SSE2.
+    if (largura_el > 1) {
+        int ancora = largura_el / 2, n = w + largura_el - 1;
+        unsigned char *p = temp, *g = p + (size_t)n * 16, *hh = g + (size_t)n * 16;
+        unsigned char *sobra = hh + (size_t)n * 16; // Linhas além da imagem no último grupo
+        memset(p, 255, (size_t)n * 16); // Só o miolo é reescrito: as margens continuam 255
+        memset(sobra, 255, w);
+        for (int y0 = 0; y0 < h; y0 += 16) {
+            unsigned char *linhas[16];
+            for (int r = 0; r < 16; ++r) linhas[r] = y0 + r < h ? m->data + (size_t)(y0 + r) * w : sobra;
+            intercalar_linhas(linhas, w, p + (size_t)ancora * 16);
+            for (int b = 0; b < n; b += largura_el) {
+                int fim = b + largura_el < n ? b + largura_el : n;
+                memcpy(g + (size_t)b * 16, p + (size_t)b * 16, 16);
+                for (int j = b + 1; j < fim; ++j) minimo_16(g + (size_t)(j - 1) * 16, p + (size_t)j * 16, g + (size_t)j * 16);
+                memcpy(hh + (size_t)(fim - 1) * 16, p + (size_t)(fim - 1) * 16, 16);
+                for (int j = fim - 2; j >= b; --j) minimo_16(hh + (size_t)(j + 1) * 16, p + (size_t)j * 16, hh + (size_t)j * 16);
+            }
+            minimo_linhas(hh, g + (size_t)(largura_el - 1) * 16, hh, (size_t)w * 16);
+            desintercalar_linhas(hh, w, linhas);
+        }
+    }
+    // Vertical: vHGW sobre trechos de linha; as linhas fora da imagem valem 255.
+    // Uma faixa de colunas por vez, para que g e h fiquem na cache.
+    if (altura_el > 1) {
+        int ancora = altura_el / 2, n = h + altura_el - 1;
+        int faixa = colunas_por_faixa(n, w, 1, 16);
+        unsigned char *g = temp, *hh = g + (size_t)n * faixa, *cheia = hh + (size_t)n * faixa;
+        memset(cheia, 255, faixa);
+        for (int x0 = 0; x0 < w; x0 += faixa) {
+            int l = w - x0 < faixa ? w - x0 : faixa;
+            for (int j = 0; j < n; ++j) {
+                const unsigned char *p = (j >= ancora && j - ancora < h) ? m->data + (size_t)(j - ancora) * w + x0 : cheia;
+                if (j % altura_el == 0) memcpy(g + (size_t)j * l, p, l);
+                else minimo_linhas(g + (size_t)(j - 1) * l, p, g + (size_t)j * l, l);
+            }
+            for (int j = n - 1; j >= 0; --j) {
+                const unsigned char *p = (j >= ancora && j - ancora < h) ? m->data + (size_t)(j - ancora) * w + x0 : cheia;
+                if (j == n - 1 || j % altura_el == altura_el - 1) memcpy(hh + (size_t)j * l, p, l);
+                else minimo_linhas(hh + (size_t)(j + 1) * l, p, hh + (size_t)j * l, l);
+            }
+            for (int y = 0; y < h; ++y) {
+                minimo_linhas(hh + (size_t)y * l, g + (size_t)(y + altura_el - 1) * l, m->data + (size_t)y * w + x0, l);
+            }
+        }
+    }
+}
+
+static void dilatar_bytes(Image *m, int largura_el, int altura_el, unsigned char *temp) {
+    complementar_bytes(m->data, (size_t)m->width * m->height);
+    erodir_bytes(m, largura_el, altura_el, temp);
+    complementar_bytes(m->data, (size_t)m->width * m->height);
+}
+
+/**
+ * @brief Aplica uma operação morfológica a uma máscara de bytes de 1 canal (0/255), no lugar.
+ * Os temporários são pedidos antes de qualquer passada: se faltar memória, a
+ * máscara fica intacta.
+ * @return false se faltar memória.
+ */
+DETECTOR_INTERNO bool morfologia_bytes(Image *mascara, OperacaoMorfologica op, int largura_el, int altura_el) {
+    size_t tamanho = temporarios_erosao_bytes(mascara, largura_el, altura_el);
+    unsigned char *temp = (unsigned char *)reserva_obter(tamanho > 0 ? tamanho : 1);
+    if (!temp) return false;
+    if (op == MORF_EROSAO || op == MORF_ABERTURA) erodir_bytes(mascara, largura_el, altura_el, temp);
+    if (op != MORF_EROSAO) dilatar_bytes(mascara, largura_el, altura_el, temp);
+    if (op == MORF_FECHAMENTO) erodir_bytes(mascara, largura_el, altura_el, temp);
+    reserva_devolver(temp);
+    return true;
+}
+
+// ---- Máscaras de bits ----
+
+/**
+ * @brief saida[x] = entrada[x + s] (s pode ser negativo), com 1 fora da linha.
+ */
+static void deslocar_bits(const uint64_t *entrada, uint64_t *saida, int n, int s) {
+    const uint64_t uns = ~0ULL;
+    if (s >= 0) {
+        int q = s / 64, r = s % 64;
+        for (int i = 0; i < n; ++i) {
+            uint64_t baixo = i + q < n ? entrada[i + q] : uns;
+            uint64_t alto = i + q + 1 < n ? entrada[i + q + 1] : uns;
+            saida[i] = r ? (baixo >> r) | (alto << (64 - r)) : baixo;
+        }
+    } else {
+        int q = -s / 64, r = -s % 64;
+        for (int i = 0; i < n; ++i) {
+            uint64_t alto = i - q >= 0 ? entrada[i - q] : uns;
+            uint64_t baixo = i - q - 1 >= 0 ? entrada[i - q - 1] : uns;
+            saida[i] = r ? (alto << r) | (baixo >> (64 - r)) : alto;
+        }
+    }
+}
+
+// Bits da última palavra além da largura: 1 durante a erosão, 0 na máscara final.
+static inline uint64_t bits_alem_da_largura(int largura) {
+    return largura % 64 ? ~0ULL << (largura % 64) : 0;
+}
+
+static void complementar_bits(MascaraBits *m) {
+    uint64_t cauda = bits_alem_da_largura(m->width);
+    for (int y = 0; y < m->height; ++y) {
+        uint64_t *linha = mascara_bits_linha(m, y);
+        for (int i = 0; i < m->palavras_por_linha; ++i) linha[i] = ~linha[i];
+        if (m->palavras_por_linha > 0) linha[m->palavras_por_linha - 1] &= ~cauda;
+    }
+}
+
+/**
+ * @brief Palavras de temporários de erodir_bits (o maior entre as duas passadas, que as reaproveitam).
+ */
+static size_t temporarios_erosao_bits(const MascaraBits *m, int largura_el, int altura_el) {
+    size_t horizontal = 0, vertical = 0;
+    if (largura_el > 1) horizontal = 3 * (size_t)(m->palavras_por_linha + (largura_el / 2 + 63) / 64);
+    if (altura_el > 1) {
+        int total = m->height + altura_el - 1;
+        vertical = (2 * (size_t)total + 1) * colunas_por_faixa(total, m->palavras_por_linha, sizeof(uint64_t), 1);
+    }
+    return horizontal > vertical ? horizontal : vertical;
+}
+
+/**
+ * @brief Erosão de uma máscara de bits por um retângulo largura x altura, no lugar.
+ * 'temp' tem temporarios_erosao_bits palavras.
+ */
+static void erodir_bits(MascaraBits *m, int largura_el, int altura_el, uint64_t *temp) {
+    int n = m->palavras_por_linha, h = m->height;
+    uint64_t cauda = bits_alem_da_largura(m->width);
+    if (n == 0 || h == 0) return;
+    // Horizontal: E de largura_el bits consecutivos por duplicação. A linha de
+    // trabalho tem palavras extras para que o deslocamento que centraliza a
+    // janela não descarte os últimos pixels.
+    if (largura_el > 1) {
+        int ancora = largura_el / 2, ne = n + (ancora + 63) / 64;
+        uint64_t *p = temp, *t = p + ne, *acumulado = p + 2 * ne;
+        for (int y = 0; y < h; ++y) {
+            uint64_t *linha = mascara_bits_linha(m, y);
+            memcpy(t, linha, sizeof(uint64_t) * n);
+            t[n - 1] |= cauda;
+            for (int i = n; i < ne; ++i) t[i] = ~0ULL;
+            deslocar_bits(t, p, ne, -ancora); // p[x] = linha[x - ancora]
+            for (int i = 0; i < ne; ++i) acumulado[i] = ~0ULL;
+            // p cobre janelas de 'potencia' bits; 'coberto' bits já entraram no acumulado
+            int coberto = 0;
+            for (int potencia = 1; potencia <= largura_el; potencia *= 2) {
+                if (largura_el & potencia) {
+                    deslocar_bits(p, t, ne, coberto);
+                    for (int i = 0; i < ne; ++i) acumulado[i] &= t[i];
+                    coberto += potencia;
+                }
+                if (potencia * 2 > largura_el) break;
+                deslocar_bits(p, t, ne, potencia);
+                for (int i = 0; i < ne; ++i) p[i] &= t[i];
+            }
+            memcpy(linha, acumulado, sizeof(uint64_t) * n);
+        }
+    }
+    // Vertical: vHGW sobre as palavras das linhas; as linhas fora da imagem valem 1.
+    // Como nas máscaras de bytes, uma faixa de palavras por vez.
+    if (altura_el > 1) {
+        int ancora = altura_el / 2, total = h + altura_el - 1;
+        int faixa = colunas_por_faixa(total, n, sizeof(uint64_t), 1);
+        uint64_t *g = temp, *hh = g + (size_t)total * faixa, *cheia = hh + (size_t)total * faixa;
+        for (int i = 0; i < faixa; ++i) cheia[i] = ~0ULL;
+        for (int i0 = 0; i0 < n; i0 += faixa) {
+            int l = n - i0 < faixa ? n - i0 : faixa;
+            for (int j = 0; j < total; ++j) {
+                const uint64_t *p = (j >= ancora && j - ancora < h) ? mascara_bits_linha(m, j - ancora) + i0 : cheia;
+                uint64_t *gj = g + (size_t)j * l;
+                if (j % altura_el == 0) memcpy(gj, p, sizeof(uint64_t) * l);
+                else for (int i = 0; i < l; ++i) gj[i] = gj[i - l] & p[i];
+            }
+            for (int j = total - 1; j >= 0; --j) {
+                const uint64_t *p = (j >= ancora && j - ancora < h) ? mascara_bits_linha(m, j - ancora) + i0 : cheia;
+                uint64_t *hj = hh + (size_t)j * l;
+                if (j == total - 1 || j % altura_el == altura_el - 1) memcpy(hj, p, sizeof(uint64_t) * l);
+                else for (int i = 0; i < l; ++i) hj[i] = hj[i + l] & p[i];
+            }
+            for (int y = 0; y < h; ++y) {
+                uint64_t *linha = mascara_bits_linha(m, y) + i0;
+                const uint64_t *a = hh + (size_t)y * l, *b = g + (size_t)(y + altura_el - 1) * l;
+                for (int i = 0; i < l; ++i) linha[i] = a[i] & b[i];
+            }
+        }
+    }
+    for (int y = 0; y < h; ++y) mascara_bits_linha(m, y)[n - 1] &= ~cauda;
+}
+
+static void dilatar_bits(MascaraBits *m, int largura_el, int altura_el, uint64_t *temp) {
+    complementar_bits(m);
+    erodir_bits(m, largura_el, altura_el, temp);
+    complementar_bits(m);
+}
+
+static void aplicar_morfologia_bits(MascaraBits *mascara, OperacaoMorfologica op, int largura_el, int altura_el,
+                                    uint64_t *temp) {
+    if (op == MORF_EROSAO || op == MORF_ABERTURA) erodir_bits(mascara, largura_el, altura_el, temp);
+    if (op != MORF_EROSAO) dilatar_bits(mascara, largura_el, altura_el, temp);
+    if (op == MORF_FECHAMENTO) erodir_bits(mascara, largura_el, altura_el, temp);
+}
+
+/**
+ * @brief Aplica uma operação morfológica a uma máscara de bits, no lugar.
+ * Os temporários são pedidos antes de qualquer passada: se faltar memória, a
+ * máscara fica intacta.
+ * @return false se faltar memória.
+ */
+DETECTOR_INTERNO bool morfologia_bits(MascaraBits *mascara, OperacaoMorfologica op, int largura_el, int altura_el) {
+    size_t palavras = temporarios_erosao_bits(mascara, largura_el, altura_el);
+    uint64_t *temp = (uint64_t *)reserva_obter(sizeof(uint64_t) * (palavras > 0 ? palavras : 1));
+    if (!temp) return false;
+    aplicar_morfologia_bits(mascara, op, largura_el, altura_el, temp);
+    reserva_devolver(temp);
+    return true;
+}
+
+// Limpeza da máscara final pedida na linha de comando (0 x 0 = desligada).
+typedef struct {
+    int abertura_largura, abertura_altura;
+    int fechamento_largura, fechamento_altura;
+} LimpezaMascara;
+
+static inline bool limpeza_ativa(const LimpezaMascara *l) {
+    return l->abertura_largura > 0 || l->fechamento_largura > 0;
+}
+
+/**
+ * @brief Abertura (remove o ruído) seguida de fechamento (fecha os buracos), se pedidos.
+ * Como em morfologia_bits, se faltar memória a máscara fica intacta.
+ * @return false se faltar memória.
+ */
+DETECTOR_INTERNO bool limpar_mascara_bits(MascaraBits *mascara, const LimpezaMascara *l) {
+    size_t abertura = l->abertura_largura > 0
+        ? temporarios_erosao_bits(mascara, l->abertura_largura, l->abertura_altura) : 0;
+    size_t fechamento = l->fechamento_largura > 0
+        ? temporarios_erosao_bits(mascara, l->fechamento_largura, l->fechamento_altura) : 0;
+    size_t palavras = abertura > fechamento ? abertura : fechamento;
+    uint64_t *temp = (uint64_t *)reserva_obter(sizeof(uint64_t) * (palavras > 0 ? palavras : 1));
+    if (!temp) return false;
+    if (l->abertura_largura > 0) {
+        aplicar_morfologia_bits(mascara, MORF_ABERTURA, l->abertura_largura, l->abertura_altura, temp);
+    }
+    if (l->fechamento_largura > 0) {
+        aplicar_morfologia_bits(mascara, MORF_FECHAMENTO, l->fechamento_largura, l->fechamento_altura, temp);
+    }
+    reserva_devolver(temp);
+    return true;
+}
+
+// -----------------------------------------------------------------
+// 14. DECODIFICAÇÃO JPEG EM ESCALA REDUZIDA (1/2, 1/4, 1/8)
+// -----------------------------------------------------------------
+// Uma pluma que cobre 0,2% do quadro continua visível em 1/4 da resolução.
+// Em vez de decodificar o JPEG inteiro e reduzir depois, a IDCT de cada bloco
+// 8x8 é trocada por uma IDCT de N pontos (N = 8/fator) sobre os N x N
+// coeficientes de frequência mais baixa, que produz diretamente a média de cada
+// região fator x fator. Com fator 8 só resta o coeficiente DC. A decodificação
+// de entropia (Huffman) não pode ser pulada, mas a IDCT, a conversão de cor e a
+// reamostragem do croma passam a custar 1/fator^2 do original.
+//
+// Usa as funções internas do stb_image.h, incluído com a implementação neste
+// mesmo arquivo: o decodificador normal preenche os planos de cada componente,
+// só que cada bloco escreve apenas o canto N x N das suas 8 x 8 posições.
+
+// Tabelas da IDCT reduzida: c[x][u] = C(u)/2 * cos((2x+1)u*pi/2N), C(0) = 1/sqrt(2).
+// O produto de duas tabelas reproduz a normalização 1/4 C(u)C(v) da IDCT 8x8 do JPEG.
+static const float IDCT_REDUZIDA_2[2][2] = {
+    {0.35355339f,  0.35355339f},
+    {0.35355339f, -0.35355339f},
+};
+static const float IDCT_REDUZIDA_4[4][4] = {
+    {0.35355339f,  0.46193977f,  0.35355339f,  0.19134172f},
+    {0.35355339f,  0.19134172f, -0.35355339f, -0.46193977f},
+    {0.35355339f, -0.19134172f, -0.35355339f,  0.46193977f},
+    {0.35355339f, -0.46193977f,  0.35355339f, -0.19134172f},
+};
+
+static inline stbi_uc saturar_byte(int v) {
+    return (stbi_uc)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/**
+ * @brief IDCT separável de n pontos sobre os n x n coeficientes de baixa frequência
+ * (já desquantizados, em ordem natural). Escreve n x n pixels a partir de 'out'.
+ */
+static inline void idct_reduzida(stbi_uc *out, int stride, const short *coef, int n, const float *tabela) {
+    float tmp[4][4]; // tmp[v][x]: linhas transformadas
+    for (int v = 0; v < n; ++v) {
+        for (int x = 0; x < n; ++x) {
+            float soma = 0.0f;
+            for (int u = 0; u < n; ++u) soma += tabela[x * n + u] * coef[v * 8 + u];
+            tmp[v][x] = soma;
+        }
+    }
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            float soma = 0.0f;
+            for (int v = 0; v < n; ++v) soma += tabela[y * n + v] * tmp[v][x];
+            out[y * stride + x] = saturar_byte((int)lrintf(soma) + 128);
+        }
+    }
+}
+
+static void idct_reduzida_4x4(stbi_uc *out, int stride, short coef[64]) {
+    idct_reduzida(out, stride, coef, 4, &IDCT_REDUZIDA_4[0][0]);
+}
+
+static void idct_reduzida_2x2(stbi_uc *out, int stride, short coef[64]) {
+    idct_reduzida(out, stride, coef, 2, &IDCT_REDUZIDA_2[0][0]);
+}
+
+static void idct_reduzida_1x1(stbi_uc *out, int stride, short coef[64]) {
+    (void)stride;
+    out[0] = saturar_byte(((coef[0] + 4) >> 3) + 128); // DC/8, arredondado
+}
+
+/**
+ * @brief Reduz uma imagem RGB por média de blocos fator x fator (caminho genérico
+ * para formatos que não são JPEG). Libera 'rgb'.
+ */
+static unsigned char *reduzir_por_media(unsigned char *rgb, int largura, int altura, int fator,
+                                        int *largura_saida, int *altura_saida) {
+    int lw = (largura + fator - 1) / fator;
+    int lh = (altura + fator - 1) / fator;
+    unsigned char *saida = (unsigned char *)reserva_obter((size_t)lw * lh * 3);
+    for (int y = 0; y < lh; ++y) {
+        int y1 = (y + 1) * fator < altura ? (y + 1) * fator : altura;
+        for (int x = 0; x < lw; ++x) {
+            int x1 = (x + 1) * fator < largura ? (x + 1) * fator : largura;
+            int soma[3] = {0, 0, 0}, n = 0;
+            for (int yy = y * fator; yy < y1; ++yy) {
+                const unsigned char *p = rgb + ((size_t)yy * largura + x * fator) * 3;
+                for (int xx = x * fator; xx < x1; ++xx, p += 3, ++n) {
+                    soma[0] += p[0];
+                    soma[1] += p[1];
+                    soma[2] += p[2];
+                }
+            }
+            unsigned char *q = saida + ((size_t)y * lw + x) * 3;
+            for (int c = 0; c < 3; ++c) q[c] = (unsigned char)((soma[c] + n / 2) / n);
+        }
+    }
+    stbi_image_free(rgb);
+    *largura_saida = lw;
+    *altura_saida = lh;
+    return saida;
+}
+
+/**
+ * @brief Avança sobre os dados de entropia de uma varredura sem decodificá-los.
+ * @return O marcador seguinte (RSTn e bytes de enchimento 0xFF00 são ignorados).
+ */
+static stbi_uc pular_dados_entropia(stbi__jpeg *j) {
+    while (!stbi__at_eof(j->s)) {
+        if (stbi__get8(j->s) != 0xff) continue;
+        stbi_uc x = stbi__get8(j->s);
+        while (x == 0xff) x = stbi__get8(j->s);
+        if (x != 0 && !STBI__RESTART(x)) return x;
+    }
+    return STBI__MARKER_none;
+}
+
+/**
+ * @brief Equivalente a stbi__decode_jpeg_image para a escala reduzida. Em JPEGs
+ * progressivos a etapa final desquantiza só os coeficientes usados e, em 1/8, as
+ * varreduras AC são puladas sem decodificação de Huffman: só o DC é necessário.
+ * Em 1/2 e 1/4 nenhuma varredura pode ser pulada, porque as varreduras de
+ * refinamento AC (por exemplo, da banda 1-63) só são interpretadas corretamente
+ * conhecendo quais coeficientes da banda inteira já são não nulos.
+ */
+static int decodificar_coeficientes_reduzidos(stbi__jpeg *j, int lado) {
+    for (int m = 0; m < 4; ++m) {
+        j->img_comp[m].raw_data = NULL;
+        j->img_comp[m].raw_coeff = NULL;
+    }
+    j->restart_interval = 0;
+    if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
+    int m = stbi__get_marker(j);
+    while (!stbi__EOI(m)) {
+        if (stbi__SOS(m)) {
+            if (!stbi__process_scan_header(j)) return 0;
+            if (j->progressive && lado == 1 && j->spec_start > 0) {
+                j->marker = pular_dados_entropia(j);
+            } else {
+                if (!stbi__parse_entropy_coded_data(j)) return 0;
+                if (j->marker == STBI__MARKER_none) j->marker = stbi__skip_jpeg_junk_at_end(j);
+            }
+            m = stbi__get_marker(j);
+            if (STBI__RESTART(m)) m = stbi__get_marker(j);
+        } else if (stbi__DNL(m)) {
+            int ld = stbi__get16be(j->s);
+            stbi__uint32 nl = stbi__get16be(j->s);
+            if (ld != 4 || nl != j->s->img_y) return 0;
+            m = stbi__get_marker(j);
+        } else {
+            if (!stbi__process_marker(j, m)) return 1;
+            m = stbi__get_marker(j);
+        }
+    }
+    if (j->progressive) {
+        for (int n = 0; n < j->s->img_n; ++n) {
+            int bw = (j->img_comp[n].x + 7) >> 3;
+            int bh = (j->img_comp[n].y + 7) >> 3;
+            const stbi__uint16 *dequant = j->dequant[j->img_comp[n].tq];
+            for (int by = 0; by < bh; ++by) {
+                for (int bx = 0; bx < bw; ++bx) {
+                    short *coef = j->img_comp[n].coeff + 64 * (bx + by * j->img_comp[n].coeff_w);
+                    for (int v = 0; v < lado; ++v) {
+                        for (int u = 0; u < lado; ++u) coef[v * 8 + u] *= dequant[v * 8 + u];
+                    }
+                    j->idct_block_kernel(j->img_comp[n].data + j->img_comp[n].w2 * by * 8 + bx * 8,
+                                         j->img_comp[n].w2, coef);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Decodifica um JPEG já reduzido. Devolve NULL se o arquivo não for um JPEG
+ * de 1 ou 3 componentes (o chamador recorre ao caminho genérico).
+ */
+static unsigned char *decodificar_jpeg_reduzido(FILE *f, int fator, int *largura, int *altura) {
+    stbi__context s;
+    stbi__start_file(&s, f);
+    if (!stbi__jpeg_test(&s)) return NULL;
+
+    stbi__jpeg *j = (stbi__jpeg *)reserva_obter_zerado(sizeof(stbi__jpeg));
+    j->s = &s;
+    stbi__setup_jpeg(j);
+    j->idct_block_kernel = fator == 8 ? idct_reduzida_1x1 : (fator == 4 ? idct_reduzida_2x2 : idct_reduzida_4x4);
+    int lado = 8 / fator; // pixels válidos por bloco em cada eixo
+    s.img_n = 0;          // torna stbi__cleanup_jpeg seguro
+    if (!decodificar_coeficientes_reduzidos(j, lado) || (s.img_n != 1 && s.img_n != 3)) {
+        stbi__cleanup_jpeg(j);
+        reserva_devolver(j);
+        return NULL;
+    }
+
+    int lw = (s.img_x + fator - 1) / fator;
+    int lh = (s.img_y + fator - 1) / fator;
+    bool componentes_rgb = s.img_n == 3 && (j->rgb == 3 || (j->app14_color_transform == 0 && !j->jfif));
+    // +1: a conversão YCbCr -> RGB do stb escreve um byte de alfa após o último pixel
+    unsigned char *saida = (unsigned char *)reserva_obter((size_t)lw * lh * 3 + 1);
+    stbi_uc *linhas = (stbi_uc *)reserva_obter((size_t)lw * 3);
+
+    // Deslocamento, dentro da linha do plano, de cada coluna de saída (croma
+    // replicado pelo vizinho mais próximo)
+    int *colunas = (int *)reserva_obter(sizeof(int) * lw * s.img_n);
+    for (int k = 0; k < s.img_n; ++k) {
+        int hs = j->img_h_max / j->img_comp[k].h;
+        for (int x = 0; x < lw; ++x) {
+            int cx = x / hs;
+            colunas[k * lw + x] = (cx / lado) * 8 + cx % lado;
+        }
+    }
+
+    for (int y = 0; y < lh; ++y) {
+        for (int k = 0; k < s.img_n; ++k) {
+            int cy = y / (j->img_v_max / j->img_comp[k].v);
+            const stbi_uc *plano = j->img_comp[k].data + (size_t)((cy / lado) * 8 + cy % lado) * j->img_comp[k].w2;
+            const int *coluna = colunas + (size_t)k * lw;
+            stbi_uc *linha = linhas + (size_t)k * lw;
+            for (int x = 0; x < lw; ++x) linha[x] = plano[coluna[x]];
+        }
+        unsigned char *out = saida + (size_t)y * lw * 3;
+        if (s.img_n == 1) {
+            for (int x = 0; x < lw; ++x) out[3 * x] = out[3 * x + 1] = out[3 * x + 2] = linhas[x];
+        } else if (componentes_rgb) {
+            for (int x = 0; x < lw; ++x) {
+                out[3 * x] = linhas[x];
+                out[3 * x + 1] = linhas[lw + x];
+                out[3 * x + 2] = linhas[2 * lw + x];
+            }
+        } else {
+            j->YCbCr_to_RGB_kernel(out, linhas, linhas + lw, linhas + 2 * lw, lw, 3);
+        }
+    }
+
+    reserva_devolver(colunas);
+    reserva_devolver(linhas);
+    stbi__cleanup_jpeg(j);
+    reserva_devolver(j);
+    *largura = lw;
+    *altura = lh;
+    return saida;
+}
+
+/**
+ * @brief Carrega uma imagem como RGB (3 canais) reduzida por 'fator' (1, 2, 4 ou 8).
+ * JPEGs são decodificados direto na escala reduzida; os demais formatos são
+ * decodificados inteiros e reduzidos por média. Libere com stbi_image_free.
+ * @return NULL se a imagem não puder ser lida.
+ */
+DETECTOR_INTERNO unsigned char *carregar_rgb_reduzido(const char *caminho, int fator, int *largura, int *altura) {
+    int canais;
+    if (fator <= 1) return stbi_load(caminho, largura, altura, &canais, 3);
+
+    FILE *f = stbi__fopen(caminho, "rb");
+    if (f == NULL) return NULL;
+    unsigned char *rgb = decodificar_jpeg_reduzido(f, fator, largura, altura);
+    if (rgb == NULL) {
+        fseek(f, 0, SEEK_SET);
+        int w, h;
+        unsigned char *inteira = stbi_load_from_file(f, &w, &h, &canais, 3);
+        if (inteira != NULL) rgb = reduzir_por_media(inteira, w, h, fator, largura, altura);
+    }
+    fclose(f);
+    return rgb;
+}
+
+// Triagem pela miniatura DC: a maioria dos quadros não tem fumaça. Antes da
+// decodificação completa, o JPEG é decodificado em 1/8 (só as médias dos blocos
+// 8x8) e as regras, com limiares relaxados, são aplicadas a essa miniatura. Só
+// uma miniatura suspeita segue para a decodificação e a análise completas, que
+// dão o veredito exato; uma miniatura descartada pode, raramente, ser um falso
+// negativo (veja LIMIARES_TRIAGEM).
+
+// Limiares relaxados da triagem: a média de um bloco mistura os pixels de fumaça
+// com o fundo. Nas imagens de teste, 96-100% dos pixels de fumaça caem em blocos
+// marcados com estes limiares. Não é uma garantia: uma pluma fina ou misturada
+// ao fundo pode não mover a média de nenhum bloco. Por isso os vizinhos (8
+// direções) de cada bloco marcado também contam como candidatos, o que cobre as
+// bordas das plumas, onde a média do bloco é a mais diluída: com eles, a
+// cobertura nas imagens de teste sobe para 99,6-100%.
+static const LimiaresFumaca LIMIARES_TRIAGEM = {160, 45, 90, 120};
+
+typedef struct {
+    long blocos_candidatos; // Blocos 8x8 marcados pelas regras relaxadas, mais os vizinhos deles
+    long blocos;
+    bool suspeita;          // Os blocos candidatos cobrem mais que o limiar de detecção
+} TriagemMiniatura;
+
+/**
+ * @brief Decodifica só a miniatura DC da imagem e marca os blocos candidatos.
+ * Se eles não cobrem mais que 'deteccao_threshold' por cento da imagem, ela é
+ * dada como sem fumaça. É uma heurística: em casos raros (fumaça muito rala,
+ * perto do limiar) pode dar um falso negativo que a análise completa não daria.
+ * @return false se a imagem não puder ser lida.
+ */
+DETECTOR_INTERNO bool triar_miniatura(const char *caminho, float deteccao_threshold, TriagemMiniatura *t) {
+    int largura, altura;
+    unsigned char *miniatura = carregar_rgb_reduzido(caminho, 8, &largura, &altura);
+    if (miniatura == NULL) return false;
+    unsigned char *marcados = (unsigned char *)reserva_obter((size_t)largura * altura);
+    if (marcados == NULL) {
+        stbi_image_free(miniatura);
+        return false;
+    }
+    for (int y = 0; y < altura; ++y) {
+        classificar_linha_fundida(miniatura + (size_t)y * largura * 3, 3, largura, &LIMIARES_TRIAGEM,
+                                  marcados + (size_t)y * largura);
+    }
+
+    // Um bloco é candidato se ele ou algum dos 8 vizinhos foi marcado
+    t->blocos = (long)largura * altura;
+    t->blocos_candidatos = 0;
+    for (int y = 0; y < altura; ++y) {
+        int y0 = y > 0 ? y - 1 : 0, y1 = y + 1 < altura ? y + 1 : altura - 1;
+        for (int x = 0; x < largura; ++x) {
+            int x0 = x > 0 ? x - 1 : 0, x1 = x + 1 < largura ? x + 1 : largura - 1;
+            bool candidato = false;
+            for (int yy = y0; yy <= y1 && !candidato; ++yy) {
+                for (int xx = x0; xx <= x1; ++xx) {
+                    if (marcados[(size_t)yy * largura + xx]) {
+                        candidato = true;
+                        break;
+                    }
+                }
+            }
+            t->blocos_candidatos += candidato;
+        }
+    }
+    t->suspeita = 100.0f * t->blocos_candidatos / t->blocos > deteccao_threshold;
+    reserva_devolver(marcados);
+    stbi_image_free(miniatura);
+    return true;
+}
+
+// -----------------------------------------------------------------
+// 15. PROCESSAMENTO EM LOTE (DECODIFICAR -> CLASSIFICAR -> GRAVAR)
+// -----------------------------------------------------------------
+// Um único processo analisa muitas imagens: um diretório, um padrão glob ou
+// uma lista de caminhos (um por linha) na entrada padrão. Três estágios rodam
+// em paralelo, ligados por filas limitadas: uma thread decodifica (stbi_load),
+// a thread principal classifica (usando o pool de faixas) e uma terceira grava
+// as máscaras PNG e imprime uma linha de resultado por imagem, na ordem de entrada.
+
+#define CAPACIDADE_FILA_LOTE 4
+
+// Fila FIFO limitada entre estágios: inserir bloqueia com a fila cheia,
+// retirar bloqueia com a fila vazia e devolve NULL depois de fechada e esvaziada.
+typedef struct {
+    void **itens;
+    int capacidade;
+    int inicio;
+    int quantidade;
+    bool fechada;
+    pthread_mutex_t mutex;
+    pthread_cond_t nao_vazia;
+    pthread_cond_t nao_cheia;
+} FilaLimitada;
+
+DETECTOR_INTERNO void fila_iniciar(FilaLimitada *f, int capacidade) {
+    f->itens = (void **)malloc(sizeof(void *) * capacidade);
+    f->capacidade = capacidade;
+    f->inicio = 0;
+    f->quantidade = 0;
+    f->fechada = false;
+    pthread_mutex_init(&f->mutex, NULL);
+    pthread_cond_init(&f->nao_vazia, NULL);
+    pthread_cond_init(&f->nao_cheia, NULL);
+}
+
+DETECTOR_INTERNO void fila_destruir(FilaLimitada *f) {
+    pthread_mutex_destroy(&f->mutex);
+    pthread_cond_destroy(&f->nao_vazia);
+    pthread_cond_destroy(&f->nao_cheia);
+    free(f->itens);
+}
+
+DETECTOR_INTERNO void fila_inserir(FilaLimitada *f, void *item) {
+    pthread_mutex_lock(&f->mutex);
+    while (f->quantidade == f->capacidade) pthread_cond_wait(&f->nao_cheia, &f->mutex);
+    f->itens[(f->inicio + f->quantidade) % f->capacidade] = item;
+    f->quantidade++;
+    pthread_cond_signal(&f->nao_vazia);
+    pthread_mutex_unlock(&f->mutex);
+}
+
+DETECTOR_INTERNO void *fila_retirar(FilaLimitada *f) {
+    pthread_mutex_lock(&f->mutex);
+    while (f->quantidade == 0 && !f->fechada) pthread_cond_wait(&f->nao_vazia, &f->mutex);
+    void *item = NULL;
+    if (f->quantidade > 0) {
+        item = f->itens[f->inicio];
+        f->inicio = (f->inicio + 1) % f->capacidade;
+        f->quantidade--;
+        pthread_cond_signal(&f->nao_cheia);
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return item;
+}
+
+/**
+ * @brief Indica que nada mais será inserido; quem espera em fila_retirar recebe NULL.
+ */
+DETECTOR_INTERNO void fila_fechar(FilaLimitada *f) {
+    pthread_mutex_lock(&f->mutex);
+    f->fechada = true;
+    pthread_cond_broadcast(&f->nao_vazia);
+    pthread_mutex_unlock(&f->mutex);
+}
+
+typedef struct {
+    char caminho[1024];
+    Image img;              // RGB (3 canais); data == NULL se a decodificação falhou
+    MascaraBits mascara;    // Só preenchida quando as máscaras são gravadas
+    long contagem;
+    float percentual;
+    float percentual_maior_regiao; // Só com a rotulagem de regiões (senão negativo)
+    bool fumaca;
+    bool decisao_antecipada; // Modo alarme: 'percentual' não se aplica
+    bool descartada;         // Triagem: miniatura sem suspeita, nunca decodificada inteira
+    MetricasImagem metricas; // Só preenchidas com --metricas
+} ItemLote;
+
+typedef struct {
+    const char *entrada;    // Diretório, padrão glob ou "-" (entrada padrão)
+    const char *dir_saida;  // Onde gravar as máscaras (NULL = não grava)
+    int escala;             // Fator de redução na decodificação (1 = tamanho original)
+    bool triagem;           // Triagem pela miniatura DC antes da decodificação completa
+    bool depurar_alocacoes; // Informa na saída de erro os blocos pedidos ao sistema por imagem
+    FILE *metricas;         // Destino do JSON de métricas de cada imagem (NULL = sem métricas)
+    float deteccao_threshold;
+    bool falha_listagem;    // Faltou memória para listar as entradas (conta como erro)
+    FilaLimitada decodificadas;
+    FilaLimitada classificadas;
+} ContextoLote;
+
+static int comparar_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+DETECTOR_INTERNO void liberar_lista(char **lista, size_t n) {
+    for (size_t i = 0; i < n; ++i) free(lista[i]);
+    free(lista);
+}
+
+/**
+ * @brief Acrescenta uma cópia de 'caminho' à lista, crescendo-a quando cheia.
+ * @return false se faltar memória (a lista continua válida).
+ */
+static bool lista_acrescentar(char ***lista, size_t *n, size_t *capacidade, const char *caminho) {
+    if (*n == *capacidade) {
+        size_t nova = *capacidade ? *capacidade * 2 : 64;
+        char **maior = (char **)realloc(*lista, sizeof(char *) * nova);
+        if (!maior) return false;
+        *lista = maior;
+        *capacidade = nova;
+    }
+    char *copia = strdup(caminho);
+    if (!copia) return false;
+    (*lista)[(*n)++] = copia;
+    return true;
+}
+
+/**
+ * @brief Lista os arquivos de um diretório (em ordem alfabética) ou de um padrão glob.
+ * @return Vetor de caminhos alocados (liberar com liberar_lista), com o tamanho em *n,
+ *         ou NULL (com *n = 0) se faltar memória.
+ */
+DETECTOR_INTERNO char **listar_entradas(const char *entrada, size_t *n) {
+    char **lista = NULL;
+    size_t capacidade = 0;
+    bool ok = true;
+    *n = 0;
+    struct stat st;
+    if (stat(entrada, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(entrada);
+        struct dirent *entry;
+        while (ok && dir && (entry = readdir(dir)) != NULL) {
+            char caminho[1024];
+            snprintf(caminho, sizeof(caminho), "%s/%s", entrada, entry->d_name);
+            if (stat(caminho, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+            ok = lista_acrescentar(&lista, n, &capacidade, caminho);
+        }
+        if (dir) closedir(dir);
+        if (ok && *n > 1) qsort(lista, *n, sizeof(char *), comparar_strings);
+    } else {
+        bool por_glob = false;
+#ifndef _WIN32
+        glob_t g;
+        if (glob(entrada, 0, NULL, &g) == 0) {
+            por_glob = true;
+            for (size_t i = 0; ok && i < g.gl_pathc; ++i) ok = lista_acrescentar(&lista, n, &capacidade, g.gl_pathv[i]);
+            globfree(&g);
+        }
+#endif
+        // Sem glob: trata a entrada como um único arquivo
+        if (!por_glob) ok = lista_acrescentar(&lista, n, &capacidade, entrada);
+    }
+    // Um diretório vazio devolve uma lista vazia, não NULL
+    if (ok && !lista) ok = (lista = (char **)malloc(sizeof(char *))) != NULL;
+    if (!ok) {
+        liberar_lista(lista, *n);
+        *n = 0;
+        return NULL;
+    }
+    return lista;
+}
+
+static void decodificar_para_fila(ContextoLote *ctx, const char *caminho) {
+    ItemLote *item = (ItemLote *)reserva_obter_zerado(sizeof(ItemLote));
+    snprintf(item->caminho, sizeof(item->caminho), "%s", caminho);
+    MetricasImagem *metricas = ctx->metricas ? &item->metricas : NULL;
+    if (metricas) {
+        metricas_iniciar(metricas);
+        metricas->bytes_lidos = tamanho_arquivo(caminho);
+    }
+    TriagemMiniatura t;
+    MarcaTempo inicio = metricas_marcar(metricas, NULL);
+    bool suspeita = true;
+    if (ctx->triagem) {
+        suspeita = !triar_miniatura(caminho, ctx->deteccao_threshold, &t) || t.suspeita;
+        metricas_registrar(metricas, ETAPA_TRIAGEM, &inicio, NULL);
+    }
+    if (!suspeita) {
+        item->descartada = true;
+    } else {
+        inicio = metricas_marcar(metricas, NULL);
+        item->img.data = carregar_rgb_reduzido(caminho, ctx->escala, &item->img.width, &item->img.height);
+        metricas_registrar(metricas, ETAPA_DECODIFICAR, &inicio, NULL);
+    }
+    item->img.channels = 3;
+    fila_inserir(&ctx->decodificadas, item);
+}
+
+/**
+ * @brief Estágio 1: enumera as entradas e decodifica cada imagem.
+ */
+static void *estagio_decodificar(void *arg) {
+    ContextoLote *ctx = (ContextoLote *)arg;
+    if (strcmp(ctx->entrada, "-") == 0) {
+        char linha[1024];
+        while (fgets(linha, sizeof(linha), stdin)) {
+            linha[strcspn(linha, "\r\n")] = '\0';
+            if (linha[0] != '\0') decodificar_para_fila(ctx, linha);
+        }
+    } else {
+        size_t n;
+        char **lista = listar_entradas(ctx->entrada, &n);
+        if (!lista) {
+            fprintf(stderr, "ERRO: Memória insuficiente para listar '%s'.\n", ctx->entrada);
+            ctx->falha_listagem = true;
+        }
+        for (size_t i = 0; i < n; ++i) decodificar_para_fila(ctx, lista[i]);
+        liberar_lista(lista, n);
+    }
+    fila_fechar(&ctx->decodificadas);
+    return NULL;
+}
+
+/**
+ * @brief Monta "<dir_saida>/<nome sem extensão>_fumaca.png".
+ */
+DETECTOR_INTERNO void caminho_mascara_saida(const char *dir_saida, const char *caminho, char *saida, size_t tamanho) {
+    const char *nome = caminho;
+    for (const char *p = caminho; *p; ++p) {
+        if (*p == '/' || *p == '\\') nome = p + 1;
+    }
+    const char *ponto = strrchr(nome, '.');
+    int comprimento = ponto ? (int)(ponto - nome) : (int)strlen(nome);
+    snprintf(saida, tamanho, "%s/%.*s_fumaca.png", dir_saida, comprimento, nome);
+}
+
+/**
+ * @brief Estágio 3: grava a máscara (se pedido) e imprime o resultado da imagem.
+ */
+static void *estagio_gravar(void *arg) {
+    ContextoLote *ctx = (ContextoLote *)arg;
+    long alocacoes_anteriores = reserva_alocacoes_heap();
+    ItemLote *item;
+    while ((item = (ItemLote *)fila_retirar(&ctx->classificadas)) != NULL) {
+        MetricasImagem *metricas = ctx->metricas ? &item->metricas : NULL;
+        if (item->mascara.palavras) {
+            char caminho[2048];
+            caminho_mascara_saida(ctx->dir_saida, item->caminho, caminho, sizeof(caminho));
+            MarcaTempo inicio = metricas_marcar(metricas, NULL);
+            if (!salvar_mascara_bits_png(caminho, &item->mascara)) {
+                fprintf(stderr, "ERRO: Não foi possível gravar '%s'\n", caminho);
+            }
+            metricas_registrar(metricas, ETAPA_GRAVAR, &inicio, NULL);
+            if (metricas) metricas->bytes_gravados = tamanho_arquivo(caminho);
+            mascara_bits_liberar(&item->mascara);
+        }
+        if (item->img.width == 0 && !item->descartada) {
+            printf("%s\tERRO\t-\n", item->caminho);
+        } else if (item->decisao_antecipada) {
+            printf("%s\t%s\t-\n", item->caminho, item->fumaca ? "FUMACA" : "SEM_FUMACA");
+        } else if (item->percentual_maior_regiao >= 0.0f) {
+            printf("%s\t%s\t%.4f\t%.4f\n", item->caminho, item->fumaca ? "FUMACA" : "SEM_FUMACA",
+                   item->percentual, item->percentual_maior_regiao);
+        } else {
+            printf("%s\t%s\t%.4f\n", item->caminho, item->fumaca ? "FUMACA" : "SEM_FUMACA", item->percentual);
+        }
+        fflush(stdout);
+        if (metricas) metricas_escrever_json(ctx->metricas, item->caminho, item->img.width, item->img.height, metricas);
+        if (ctx->depurar_alocacoes) {
+            // Depois das primeiras imagens de cada resolução, deve ficar em 0
+            long alocacoes = reserva_alocacoes_heap();
+            fprintf(stderr, "%s\talocacoes_heap=%ld\n", item->caminho, alocacoes - alocacoes_anteriores);
+            alocacoes_anteriores = alocacoes;
+        }
+        reserva_devolver(item);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Processa um lote inteiro. A thread chamadora é o estágio de classificação.
+ * Imprime uma linha por imagem: caminho, FUMACA/SEM_FUMACA/ERRO e o percentual de fumaça
+ * (com 'por_regioes', uma quarta coluna com o percentual da maior região, que decide o alarme).
+ * @return Número de imagens que não puderam ser lidas ou rotuladas (mais 1 se a listagem das entradas falhar).
+ */
+DETECTOR_INTERNO int executar_lote(const char *entrada, const char *dir_saida, int escala, bool triagem,
+                  const LimpezaMascara *limpeza, bool por_regioes, PoolThreads *pool,
+                  const Classificador *classificador, bool modo_alarme, bool depurar_alocacoes,
+                  FILE *metricas, float deteccao_threshold) {
+    ContextoLote ctx;
+    ctx.entrada = entrada;
+    ctx.dir_saida = dir_saida;
+    ctx.escala = escala;
+    ctx.triagem = triagem;
+    ctx.depurar_alocacoes = depurar_alocacoes;
+    ctx.metricas = metricas;
+    ctx.deteccao_threshold = deteccao_threshold;
+    ctx.falha_listagem = false;
+    fila_iniciar(&ctx.decodificadas, CAPACIDADE_FILA_LOTE);
+    fila_iniciar(&ctx.classificadas, CAPACIDADE_FILA_LOTE);
+    pthread_t decodificador, gravador;
+    pthread_create(&decodificador, NULL, estagio_decodificar, &ctx);
+    pthread_create(&gravador, NULL, estagio_gravar, &ctx);
+
+    // Estágio 2: classificação
+    int erros = 0;
+    ItemLote *item;
+    while ((item = (ItemLote *)fila_retirar(&ctx.decodificadas)) != NULL) {
+        if (item->descartada) {
+            item->fumaca = false;
+            item->decisao_antecipada = true;
+        } else if (item->img.data == NULL) {
+            item->img.width = 0;
+            erros++;
+        } else {
+            long total = (long)item->img.width * item->img.height;
+            bool sem_memoria = false; // Faltou memória para a máscara, a limpeza ou as regiões
+            MetricasImagem *metricas = ctx.metricas ? &item->metricas : NULL;
+            MarcaTempo inicio = metricas_marcar(metricas, pool);
+            if (modo_alarme && dir_saida == NULL) {
+                DecisaoAlarme d = decidir_alarme(pool, classificador, &item->img, deteccao_threshold);
+                metricas_registrar(metricas, ETAPA_CLASSIFICAR, &inicio, pool);
+                if (metricas) metricas->pixels_classificados = d.pixels_analisados;
+                item->fumaca = d.fumaca_detectada;
+                item->decisao_antecipada = true;
+            } else {
+                bool criar_mascara = dir_saida || por_regioes || limpeza_ativa(limpeza);
+                if (criar_mascara) {
+                    item->mascara = mascara_bits_criar(item->img.width, item->img.height);
+                    if (item->mascara.palavras == NULL) {
+                        fprintf(stderr, "ERRO: Memória insuficiente para a máscara de '%s'\n", item->caminho);
+                        sem_memoria = true;
+                        criar_mascara = false;
+                    }
+                }
+                item->contagem = classificar_imagem(pool, classificador, &item->img,
+                                                    criar_mascara ? &item->mascara : NULL);
+                metricas_registrar(metricas, ETAPA_CLASSIFICAR, &inicio, pool);
+                if (limpeza_ativa(limpeza) && criar_mascara) {
+                    inicio = metricas_marcar(metricas, pool);
+                    if (!limpar_mascara_bits(&item->mascara, limpeza)) {
+                        fprintf(stderr, "ERRO: Memória insuficiente para limpar a máscara de '%s'\n",
+                                item->caminho);
+                        sem_memoria = true;
+                    }
+                    item->contagem = contar_mascara_bits(&item->mascara);
+                    metricas_registrar(metricas, ETAPA_LIMPEZA, &inicio, pool);
+                }
+                item->percentual = 100.0f * item->contagem / total;
+                item->fumaca = item->percentual > deteccao_threshold;
+                item->percentual_maior_regiao = -1.0f;
+                if (por_regioes && criar_mascara) {
+                    inicio = metricas_marcar(metricas, pool);
+                    RegioesFumaca regioes = rotular_regioes(pool, &item->mascara);
+                    metricas_registrar(metricas, ETAPA_REGIOES, &inicio, pool);
+                    if (regioes.falha) {
+                        fprintf(stderr, "ERRO: Memória insuficiente para rotular as regiões de '%s'\n",
+                                item->caminho);
+                        sem_memoria = true;
+                    }
+                    long maior = regioes.quantidade > 0 ? regioes.regioes[0].area : 0;
+                    item->percentual_maior_regiao = 100.0f * maior / total;
+                    item->fumaca = item->percentual_maior_regiao > deteccao_threshold;
+                    regioes_liberar(&regioes);
+                }
+                // Máscara sem a limpeza pedida não é gravada
+                if (!dir_saida || sem_memoria) mascara_bits_liberar(&item->mascara);
+                if (metricas) {
+                    inicio = metricas_marcar(metricas, pool);
+                    contar_por_regra(pool, &item->img, classificador->limiares, &metricas->fumaca_rgb,
+                                     &metricas->fumaca_hsi);
+                    metricas_registrar(metricas, ETAPA_CONTAGEM_REGRAS, &inicio, pool);
+                    metricas->pixels_classificados = total;
+                    metricas->fumaca_final = item->contagem;
+                }
+            }
+            stbi_image_free(item->img.data);
+            item->img.data = NULL;
+            if (sem_memoria) { // Sai como ERRO: o veredito dependia da máscara completa
+                item->img.width = 0;
+                erros++;
+            }
+        }
+        fila_inserir(&ctx.classificadas, item);
+    }
+    fila_fechar(&ctx.classificadas);
+
+    pthread_join(decodificador, NULL);
+    pthread_join(gravador, NULL);
+    fila_destruir(&ctx.decodificadas);
+    fila_destruir(&ctx.classificadas);
+    return erros + ctx.falha_listagem;
+}
+
+// Gravação assíncrona de máscaras: a compressão PNG (deflate) é a parte mais
+// lenta da gravação, então ela roda em uma thread própria, alimentada por uma
+// fila limitada. O veredito sai antes de a codificação terminar.
+
+#define CAPACIDADE_FILA_GRAVACAO 3
+
+// Máscaras que podem ser gravadas (combináveis com |).
+#define MASCARA_RGB    1
+#define MASCARA_HSI    2
+#define MASCARA_FINAL  4
+#define MASCARAS_TODAS (MASCARA_RGB | MASCARA_HSI | MASCARA_FINAL)
+
+typedef struct {
+    char caminho[1024];
+    MascaraBits mascara;
+} TrabalhoGravacao;
+
+typedef struct {
+    FilaLimitada fila;
+    pthread_t thread;
+    MetricasImagem *metricas; // Recebe o tempo e os bytes da gravação (NULL = sem métricas)
+} GravadorMascaras;
+
+static void *gravador_laco(void *arg) {
+    GravadorMascaras *g = (GravadorMascaras *)arg;
+    TrabalhoGravacao *t;
+    while ((t = (TrabalhoGravacao *)fila_retirar(&g->fila)) != NULL) {
+        MarcaTempo inicio = metricas_marcar(g->metricas, NULL);
+        if (!salvar_mascara_bits_png(t->caminho, &t->mascara)) {
+            fprintf(stderr, "ERRO: Não foi possível gravar '%s'\n", t->caminho);
+        }
+        metricas_registrar(g->metricas, ETAPA_GRAVAR, &inicio, NULL);
+        if (g->metricas) g->metricas->bytes_gravados += tamanho_arquivo(t->caminho);
+        mascara_bits_liberar(&t->mascara);
+        reserva_devolver(t);
+    }
+    return NULL;
+}
+
+DETECTOR_INTERNO void gravador_iniciar(GravadorMascaras *g, MetricasImagem *metricas) {
+    g->metricas = metricas;
+    fila_iniciar(&g->fila, CAPACIDADE_FILA_GRAVACAO);
+    pthread_create(&g->thread, NULL, gravador_laco, g);
+}
+
+/**
+ * @brief Agenda a gravação da máscara em PNG. O gravador assume a posse de 'mascara'.
+ */
+DETECTOR_INTERNO void gravador_enviar(GravadorMascaras *g, const char *caminho, MascaraBits *mascara) {
+    TrabalhoGravacao *t = (TrabalhoGravacao *)reserva_obter(sizeof(TrabalhoGravacao));
+    snprintf(t->caminho, sizeof(t->caminho), "%s", caminho);
+    t->mascara = *mascara;
+    mascara->palavras = NULL;
+    fila_inserir(&g->fila, t);
+}
+
+/**
+ * @brief Espera todas as gravações pendentes terminarem e encerra a thread.
+ */
+DETECTOR_INTERNO void gravador_finalizar(GravadorMascaras *g) {
+    fila_fechar(&g->fila);
+    pthread_join(g->thread, NULL);
+    fila_destruir(&g->fila);
+}
+
+// -----------------------------------------------------------------
+// 16. MODO STREAM (QUADROS RGB BRUTOS NA ENTRADA PADRÃO)
+// -----------------------------------------------------------------
+// Lê quadros RGB entrelaçados de tamanho fixo da entrada padrão, como os de
+// "ffmpeg -f rawvideo -pix_fmt rgb24 -", e imprime um veredito por quadro.
+// O buffer do quadro é alocado uma vez e reaproveitado: não há decodificação
+// nem alocação por quadro, e um único processo acompanha a câmera. Com uma
+// tabela YUV, os quadros são NV12 ("-pix_fmt nv12") e são classificados
+// direto nos planos Y e UV (seção 10).
+
+/**
+ * @brief Lê exatamente 'tamanho' bytes. @return false no fim da entrada (ou quadro incompleto).
+ */
+static bool ler_quadro(FILE *entrada, unsigned char *buffer, size_t tamanho) {
+    size_t lidos = 0;
+    while (lidos < tamanho) {
+        size_t n = fread(buffer + lidos, 1, tamanho - lidos, entrada);
+        if (n == 0) return false;
+        lidos += n;
+    }
+    return true;
+}
+
+// Modo vídeo: com câmeras fixas, quadros consecutivos são quase iguais. O quadro é
+// dividido em blocos de LADO_BLOCO_VIDEO x LADO_BLOCO_VIDEO pixels; cada bloco é
+// comparado (SIMD) com o conteúdo que tinha na última vez em que foi classificado,
+// e só os blocos alterados são reclassificados. A contagem total é mantida somando
+// a diferença de cada bloco, de modo que o custo acompanha o movimento da cena, e
+// não a resolução. Com tolerância 0 o resultado é idêntico ao da análise completa.
+
+#define LADO_BLOCO_VIDEO 64
+
+typedef struct {
+    int width;
+    int height;
+    int blocos_x;
+    int blocos_y;
+    int tolerancia;              // Diferença máxima por canal ignorada (ruído do sensor)
+    unsigned char *referencia;   // Conteúdo de cada bloco na última classificação
+    int *contagem_blocos;        // Pixels de fumaça de cada bloco
+    long *variacao_linhas;       // Variação da contagem por linha de blocos (uma posição por linha)
+    int *reclassificados_linhas; // Blocos reclassificados por linha de blocos
+    long contagem_total;
+    bool primeiro_quadro;
+} EstadoVideo;
+
+DETECTOR_INTERNO bool video_iniciar(EstadoVideo *v, int width, int height, int tolerancia) {
+    memset(v, 0, sizeof(*v));
+    v->width = width;
+    v->height = height;
+    v->blocos_x = (width + LADO_BLOCO_VIDEO - 1) / LADO_BLOCO_VIDEO;
+    v->blocos_y = (height + LADO_BLOCO_VIDEO - 1) / LADO_BLOCO_VIDEO;
+    v->tolerancia = tolerancia;
+    v->referencia = (unsigned char *)malloc((size_t)width * height * 3);
+    v->contagem_blocos = (int *)calloc((size_t)v->blocos_x * v->blocos_y, sizeof(int));
+    v->variacao_linhas = (long *)calloc(v->blocos_y, sizeof(long));
+    v->reclassificados_linhas = (int *)calloc(v->blocos_y, sizeof(int));
+    v->primeiro_quadro = true;
+    return v->referencia && v->contagem_blocos && v->variacao_linhas && v->reclassificados_linhas;
+}
+
+DETECTOR_INTERNO void video_liberar(EstadoVideo *v) {
+    free(v->referencia);
+    free(v->contagem_blocos);
+    free(v->variacao_linhas);
+    free(v->reclassificados_linhas);
+    memset(v, 0, sizeof(*v));
+}
+
+/**
+ * @brief Verifica se algum byte de um bloco difere da referência em mais de 'tolerancia'.
+ * SSE2: |a - b| = (a -sat b) | (b -sat a); 16 bytes por operação, saindo na primeira linha alterada.
+ */
+static bool bloco_alterado(const unsigned char *a, const unsigned char *b, size_t bytes_linha, int bytes_largura,
+                           int linhas, int tolerancia) {
+    for (int y = 0; y < linhas; ++y) {
+        const unsigned char *pa = a + y * bytes_linha;
+        const unsigned char *pb = b + y * bytes_linha;
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i limite = _mm_set1_epi8((char)tolerancia);
+        __m128i acumulado = _mm_setzero_si128();
+        for (; x + 16 <= bytes_largura; x += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(pa + x));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(pb + x));
+            __m128i diferenca = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            acumulado = _mm_or_si128(acumulado, _mm_subs_epu8(diferenca, limite));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acumulado, _mm_setzero_si128())) != 0xFFFF) return true;
+#endif
+        for (; x < bytes_largura; ++x) {
+            if (abs(pa[x] - pb[x]) > tolerancia) return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    EstadoVideo *video;
+    const Classificador *classificador;
+    const unsigned char *quadro;
+} ContextoVideo;
+
+/**
+ * @brief Processa uma linha de blocos: reclassifica os alterados e atualiza a referência.
+ */
+static void tarefa_video_linha_blocos(void *arg, int by) {
+    ContextoVideo *ctx = (ContextoVideo *)arg;
+    EstadoVideo *v = ctx->video;
+    size_t bytes_linha = (size_t)v->width * 3;
+    int y0 = by * LADO_BLOCO_VIDEO;
+    int linhas = v->height - y0 < LADO_BLOCO_VIDEO ? v->height - y0 : LADO_BLOCO_VIDEO;
+    long variacao = 0;
+    int reclassificados = 0;
+    for (int bx = 0; bx < v->blocos_x; ++bx) {
+        int x0 = bx * LADO_BLOCO_VIDEO;
+        int largura = v->width - x0 < LADO_BLOCO_VIDEO ? v->width - x0 : LADO_BLOCO_VIDEO;
+        size_t deslocamento = y0 * bytes_linha + (size_t)x0 * 3;
+        const unsigned char *atual = ctx->quadro + deslocamento;
+        unsigned char *referencia = v->referencia + deslocamento;
+        if (!v->primeiro_quadro &&
+            !bloco_alterado(atual, referencia, bytes_linha, largura * 3, linhas, v->tolerancia)) {
+            continue;
+        }
+        long contagem = 0;
+        for (int y = 0; y < linhas; ++y) {
+            contagem += classificar_linha(ctx->classificador, atual + y * bytes_linha, 3, largura, NULL);
+            memcpy(referencia + y * bytes_linha, atual + y * bytes_linha, (size_t)largura * 3);
+        }
+        int *contagem_bloco = &v->contagem_blocos[by * v->blocos_x + bx];
+        variacao += contagem - *contagem_bloco;
+        *contagem_bloco = (int)contagem;
+        reclassificados++;
+    }
+    v->variacao_linhas[by] = variacao;
+    v->reclassificados_linhas[by] = reclassificados;
+}
+
+/**
+ * @brief Atualiza a contagem de fumaça com um novo quadro, reclassificando só os blocos alterados.
+ * @return Número de blocos reclassificados.
+ */
+DETECTOR_INTERNO int video_processar_quadro(EstadoVideo *v, PoolThreads *pool, const Classificador *classificador,
+                           const unsigned char *quadro) {
+    ContextoVideo ctx = {v, classificador, quadro};
+    pool_executar(pool, v->blocos_y, tarefa_video_linha_blocos, &ctx);
+    int reclassificados = 0;
+    for (int by = 0; by < v->blocos_y; ++by) {
+        v->contagem_total += v->variacao_linhas[by];
+        reclassificados += v->reclassificados_linhas[by];
+    }
+    v->primeiro_quadro = false;
+    return reclassificados;
+}
+
+/**
+ * @brief Processa quadros até o fim da entrada padrão.
+ * Imprime uma linha por quadro: índice, FUMACA/SEM_FUMACA e o percentual de fumaça
+ * (no modo vídeo, também o percentual de blocos reclassificados).
+ * @param tolerancia_video Tolerância do modo vídeo, ou -1 para classificar cada quadro inteiro.
+ * @param tabela_yuv Se não for NULL, os quadros são NV12 (o modo vídeo não se aplica).
+ * @return Número de quadros processados.
+ */
+DETECTOR_INTERNO long executar_stream(int width, int height, PoolThreads *pool, const Classificador *classificador,
+                     const TabelaYuv *tabela_yuv, bool modo_alarme, int tolerancia_video,
+                     float deteccao_threshold) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    size_t tamanho_quadro = tabela_yuv ? tamanho_quadro_nv12(width, height) : (size_t)width * height * 3;
+    unsigned char *buffer = (unsigned char *)malloc(tamanho_quadro);
+    if (!buffer) return 0;
+    Image quadro = {buffer, width, height, 3};
+    QuadroNv12 quadro_nv12 = {buffer, (size_t)width, buffer + (size_t)width * height,
+                              (size_t)((width + 1) / 2) * 2, width, height};
+    long total = (long)width * height;
+
+    EstadoVideo video;
+    bool modo_video = tolerancia_video >= 0;
+    if (modo_video && !video_iniciar(&video, width, height, tolerancia_video)) {
+        video_liberar(&video);
+        free(buffer);
+        return 0;
+    }
+
+    long indice = 0;
+    while (ler_quadro(stdin, buffer, tamanho_quadro)) {
+        if (tabela_yuv) {
+            long contagem = classificar_nv12(pool, tabela_yuv, &quadro_nv12, NULL);
+            float percentual = 100.0f * contagem / total;
+            const char *veredito = percentual > deteccao_threshold ? "FUMACA" : "SEM_FUMACA";
+            if (modo_alarme) printf("%ld\t%s\t-\n", indice, veredito);
+            else printf("%ld\t%s\t%.4f\n", indice, veredito, percentual);
+        } else if (modo_video) {
+            int reclassificados = video_processar_quadro(&video, pool, classificador, buffer);
+            float percentual = 100.0f * video.contagem_total / total;
+            printf("%ld\t%s\t%.4f\t%.1f\n", indice, percentual > deteccao_threshold ? "FUMACA" : "SEM_FUMACA",
+                   percentual, 100.0f * reclassificados / (video.blocos_x * video.blocos_y));
+        } else if (modo_alarme) {
+            DecisaoAlarme d = decidir_alarme(pool, classificador, &quadro, deteccao_threshold);
+            printf("%ld\t%s\t-\n", indice, d.fumaca_detectada ? "FUMACA" : "SEM_FUMACA");
+        } else {
+            long contagem = classificar_imagem(pool, classificador, &quadro, NULL);
+            float percentual = 100.0f * contagem / total;
+            printf("%ld\t%s\t%.4f\n", indice, percentual > deteccao_threshold ? "FUMACA" : "SEM_FUMACA", percentual);
+        }
+        fflush(stdout);
+        indice++;
+    }
+    if (modo_video) video_liberar(&video);
+    free(buffer);
+    return indice;
+}
+
+// -----------------------------------------------------------------
+// 17. FUNÇÃO PRINCIPAL (MAIN)
+// -----------------------------------------------------------------
+
+/**
+ * @brief Pipeline original: uma etapa por vez, salvando as três máscaras.
+ */
+DETECTOR_INTERNO bool executar_pipeline_completo(Image *img, PoolThreads *pool, GravadorMascaras *gravador, int mascaras,
+                                const LimpezaMascara *limpeza, bool por_regioes, float deteccao_threshold,
+                                MetricasImagem *metricas) {
+    // ETAPA 1: Segmentação com RGB
+    MarcaTempo inicio = metricas_marcar(metricas, pool);
+    MascaraBits mascara_rgb = segmentar_fumaca_rgb_bits(img, &LIMIARES_PADRAO);
+    metricas_registrar(metricas, ETAPA_SEGMENTAR_RGB, &inicio, pool);
+    printf("Passo 1: Máscara RGB gerada");
+
+    // ETAPA 2: Conversão para HSI e Segmentação
+    inicio = metricas_marcar(metricas, pool);
+    MascaraBits mascara_hsi = segmentar_fumaca_hsi_bits(img, &LIMIARES_PADRAO);
+    metricas_registrar(metricas, ETAPA_SEGMENTAR_HSI, &inicio, pool);
+
+    // ETAPA 3: Combinar as máscaras
+    inicio = metricas_marcar(metricas, pool);
+    MascaraBits mascara_final = combinar_mascaras_bits(&mascara_rgb, &mascara_hsi);
+    metricas_registrar(metricas, ETAPA_COMBINAR, &inicio, pool);
+    if (limpeza_ativa(limpeza)) {
+        inicio = metricas_marcar(metricas, pool);
+        if (!limpar_mascara_bits(&mascara_final, limpeza)) {
+            printf("ERRO: Memória insuficiente para limpar a máscara; resultado sem limpeza.\n");
+        }
+        metricas_registrar(metricas, ETAPA_LIMPEZA, &inicio, pool);
+    }
+    if (metricas) {
+        inicio = metricas_marcar(metricas, pool);
+        metricas->fumaca_rgb = contar_mascara_bits(&mascara_rgb);
+        metricas->fumaca_hsi = contar_mascara_bits(&mascara_hsi);
+        metricas_registrar(metricas, ETAPA_CONTAGEM_REGRAS, &inicio, pool);
+    }
+
+    // As máscaras pedidas vão para o gravador, que assume a posse delas
+    if (mascaras & MASCARA_RGB) {
+        gravador_enviar(gravador, "resultado_fumaca_rgb.png", &mascara_rgb);
+        printf(" (gravando 'resultado_fumaca_rgb.png')");
+    }
+    printf("\nPasso 2: Máscara HSI gerada");
+    if (mascaras & MASCARA_HSI) {
+        gravador_enviar(gravador, "resultado_fumaca_hsi.png", &mascara_hsi);
+        printf(" (gravando 'resultado_fumaca_hsi.png')");
+    }
+    printf("\nPasso 3: Máscaras combinadas");
+
+    // ETAPA 4: Tomar a decisão final (pela contagem global ou pela maior região)
+    long smoke_pixel_count = contar_mascara_bits(&mascara_final);
+    RegioesFumaca regioes = {NULL, 0, false};
+    if (por_regioes) {
+        inicio = metricas_marcar(metricas, pool);
+        regioes = rotular_regioes(pool, &mascara_final);
+        metricas_registrar(metricas, ETAPA_REGIOES, &inicio, pool);
+    }
+    if (metricas) {
+        metricas->pixels_classificados = (long)img->width * img->height;
+        metricas->fumaca_final = smoke_pixel_count;
+    }
+    if (mascaras & MASCARA_FINAL) {
+        gravador_enviar(gravador, "resultado_fumaca_final.png", &mascara_final);
+        printf(" (gravando 'resultado_fumaca_final.png')");
+    }
+    printf("\n\n");
+    bool fumaca_detectada = avaliar_contagem_fumaca(smoke_pixel_count, (long)img->width * img->height,
+                                                    deteccao_threshold);
+    if (por_regioes && regioes.falha) {
+        printf("ERRO: Memória insuficiente para rotular as regiões; decisão pela contagem global.\n");
+    } else if (por_regioes) {
+        fumaca_detectada = avaliar_regioes(&regioes, (long)img->width * img->height, deteccao_threshold);
+        regioes_liberar(&regioes);
+    }
+
+    mascara_bits_liberar(&mascara_rgb);
+    mascara_bits_liberar(&mascara_hsi);
+    mascara_bits_liberar(&mascara_final);
+    return fumaca_detectada;
+}
+
+/**
+ * @brief Pipeline rápido: uma única passada com o motor fundido (ou com a tabela
+ * de consulta, se 'tabela' não for NULL) em faixas paralelas. Só existe a máscara
+ * final, que é gerada apenas se for gravada, limpa ou rotulada em regiões.
+ */
+DETECTOR_INTERNO bool executar_pipeline_fundido(Image *img, PoolThreads *pool, const TabelaFumaca *tabela,
+                               GravadorMascaras *gravador, int mascaras, const LimpezaMascara *limpeza,
+                               bool por_regioes, float deteccao_threshold, MetricasImagem *metricas) {
+    long total_pixels = (long)img->width * img->height;
+    bool gravar = (mascaras & MASCARA_FINAL) != 0;
+    bool criar_mascara = gravar || por_regioes || limpeza_ativa(limpeza);
+    MarcaTempo inicio = metricas_marcar(metricas, pool);
+    MascaraBits mascara = {0};
+    if (criar_mascara) {
+        mascara = mascara_bits_criar(img->width, img->height);
+        if (mascara.palavras == NULL) {
+            // Sem a máscara, só a contagem global sobra: nada de limpeza, regiões ou gravação
+            printf("ERRO: Memória insuficiente para a máscara; decisão pela contagem global.\n");
+            criar_mascara = gravar = false;
+        }
+    }
+    Classificador classificador = {&LIMIARES_PADRAO, tabela};
+    long smoke_pixel_count = classificar_imagem(pool, &classificador, img, criar_mascara ? &mascara : NULL);
+    metricas_registrar(metricas, ETAPA_CLASSIFICAR, &inicio, pool);
+    if (limpeza_ativa(limpeza) && criar_mascara) {
+        inicio = metricas_marcar(metricas, pool);
+        if (limpar_mascara_bits(&mascara, limpeza)) {
+            smoke_pixel_count = contar_mascara_bits(&mascara);
+        } else {
+            printf("ERRO: Memória insuficiente para limpar a máscara; resultado sem limpeza.\n");
+        }
+        metricas_registrar(metricas, ETAPA_LIMPEZA, &inicio, pool);
+    }
+    por_regioes = por_regioes && criar_mascara;
+    RegioesFumaca regioes = {NULL, 0, false};
+    if (por_regioes) {
+        inicio = metricas_marcar(metricas, pool);
+        regioes = rotular_regioes(pool, &mascara);
+        metricas_registrar(metricas, ETAPA_REGIOES, &inicio, pool);
+    }
+    if (metricas) {
+        inicio = metricas_marcar(metricas, pool);
+        contar_por_regra(pool, img, &LIMIARES_PADRAO, &metricas->fumaca_rgb, &metricas->fumaca_hsi);
+        metricas_registrar(metricas, ETAPA_CONTAGEM_REGRAS, &inicio, pool);
+        metricas->pixels_classificados = total_pixels;
+        metricas->fumaca_final = smoke_pixel_count;
+    }
+
+    if (gravar) {
+        gravador_enviar(gravador, "resultado_fumaca_final.png", &mascara);
+        printf("Passo único: Classificação concluída (gravando 'resultado_fumaca_final.png')\n\n");
+    } else {
+        printf("Passo único: Classificação concluída\n\n");
+    }
+    mascara_bits_liberar(&mascara);
+    bool fumaca_detectada = avaliar_contagem_fumaca(smoke_pixel_count, total_pixels, deteccao_threshold);
+    if (por_regioes && regioes.falha) {
+        printf("ERRO: Memória insuficiente para rotular as regiões; decisão pela contagem global.\n");
+    } else if (por_regioes) {
+        fumaca_detectada = avaliar_regioes(&regioes, total_pixels, deteccao_threshold);
+        regioes_liberar(&regioes);
+    }
+    return fumaca_detectada;
+}
+
+/**
+ * @brief Modo "só alarme": nenhuma máscara é gerada e a análise para assim que o veredito é conhecido.
+ */
+DETECTOR_INTERNO bool executar_pipeline_alarme(Image *img, PoolThreads *pool, const TabelaFumaca *tabela, float deteccao_threshold,
+                              MetricasImagem *metricas) {
+    Classificador classificador = {&LIMIARES_PADRAO, tabela};
+    MarcaTempo inicio = metricas_marcar(metricas, pool);
+    DecisaoAlarme d = decidir_alarme(pool, &classificador, img, deteccao_threshold);
+    metricas_registrar(metricas, ETAPA_CLASSIFICAR, &inicio, pool);
+    if (metricas) metricas->pixels_classificados = d.pixels_analisados; // A contagem parcial não é informada
+    long total_pixels = (long)img->width * img->height;
+    printf("Análise: decisão após classificar %.2f%% dos pixels (%ld pixels de fumaça contados).\n",
+           100.0f * d.pixels_analisados / total_pixels, d.contagem);
+    return d.fumaca_detectada;
+}
+
+// Opções de linha de comando.
+typedef struct {
+    const char *caminho_imagem;
+    const char *kernel;
+    const char *caminho_tabela;
+    const char *entrada_lote;  // Diretório, padrão glob ou "-" (NULL = uma imagem só)
+    const char *dir_saida;     // Lote: diretório das máscaras (NULL = não grava)
+    int largura_stream;        // Modo stream: dimensões dos quadros (0 = desligado)
+    int altura_stream;
+    int tolerancia_video;      // Modo stream: tolerância do modo vídeo (-1 = desligado)
+    bool nv12;                 // Modo stream: quadros NV12 em vez de RGB
+    int mascaras;              // Máscaras gravadas (MASCARA_*) no modo de uma imagem
+    int escala;                // Decodifica em 1/escala da resolução (1, 2, 4 ou 8)
+    int num_threads;
+    bool modo_rapido;
+    bool modo_alarme;
+    bool triagem;
+    bool por_regioes;
+    bool depurar_alocacoes;
+    const char *caminho_metricas; // JSON de métricas por imagem ("-" = saída de erro; NULL = desligado)
+    LimpezaMascara limpeza;
+} OpcoesDetector;
+
+DETECTOR_INTERNO void imprimir_uso(const char *programa) {
+    printf("Uso: %s [opções] [imagem]\n", programa);
+    printf("  imagem           Arquivo a analisar (padrão: imagem_teste.jpg)\n");
+    printf("  --rapido         Usa o motor fundido (uma passada; só há a máscara final)\n");
+    printf("  --mascaras <l>   Máscaras a gravar, separadas por vírgula: rgb, hsi, final,\n");
+    printf("                   ou 'nenhuma' (padrão: todas). A gravação roda em segundo plano\n");
+    printf("  --escala <n>     Decodifica a imagem em 1/n da resolução (n = 2, 4 ou 8); em\n");
+    printf("                   JPEGs a redução é feita na própria IDCT (padrão: 1)\n");
+    printf("  --abertura <LxA> Abertura morfológica da máscara final com um retângulo LxA\n");
+    printf("                   (remove o ruído menor que o retângulo)\n");
+    printf("  --fechamento <LxA>\n");
+    printf("                   Fechamento morfológico da máscara final (fecha os buracos),\n");
+    printf("                   aplicado depois da abertura\n");
+    printf("  --regioes        Separa a máscara final em regiões conexas (área, caixa, centroide)\n");
+    printf("                   e decide o alarme pela maior região (incompatível com --alarme)\n");
+    printf("  --triagem        Decodifica antes só a miniatura 1/8 (médias dos blocos 8x8) com\n");
+    printf("                   limiares relaxados; sem suspeita, dispensa a análise completa\n");
+    printf("  --kernel <nome>  Força o kernel da regra RGB: escalar, sse41 ou avx2\n");
+    printf("                   (padrão: o melhor suportado pela CPU)\n");
+    printf("  --tabela <arq>   Classifica com a tabela RGB->fumaça de 2 MB (implica --rapido).\n");
+    printf("                   Mapeia <arq> se compatível; senão constrói e salva nele\n");
+    printf("  --threads <n>    Threads usadas pelos modos rápidos (padrão: número de CPUs)\n");
+    printf("  --alarme         Só o veredito: sem máscaras, para de classificar assim que\n");
+    printf("                   a decisão estiver garantida (implica --rapido)\n");
+    printf("  --lote <entrada> Analisa várias imagens: um diretório, um padrão glob (entre\n");
+    printf("                   aspas) ou '-' para ler um caminho por linha da entrada padrão.\n");
+    printf("                   Imprime 'caminho<TAB>FUMACA|SEM_FUMACA|ERRO<TAB>percentual'\n");
+    printf("  --saida <dir>    Lote: grava a máscara final de cada imagem em <dir> (exige --lote)\n");
+    printf("  --metricas <arq> Acrescenta a <arq> ('-' = saída de erro) um objeto JSON por imagem\n");
+    printf("                   com tempo de parede e de CPU por etapa, bytes, contagens por\n");
+    printf("                   regra e pico de memória (modos de uma imagem e lote)\n");
+    printf("  --depurar-alocacoes\n");
+    printf("                   Lote: informa na saída de erro quantos blocos de memória foram\n");
+    printf("                   pedidos ao sistema desde a imagem anterior (0 em regime)\n");
+    printf("  --stream <LxA>   Lê quadros RGB brutos (rgb24) de LxA pixels da entrada padrão\n");
+    printf("                   e imprime 'quadro<TAB>FUMACA|SEM_FUMACA<TAB>percentual'\n");
+    printf("  --nv12           Stream: quadros NV12 (-pix_fmt nv12), classificados direto nos\n");
+    printf("                   planos Y e UV por uma tabela YUV (BT.601, faixa limitada)\n");
+    printf("  --video [tol]    Stream: reclassifica só os blocos de 64x64 que mudaram desde o\n");
+    printf("                   quadro anterior (diferença por canal > tol, padrão 0 = exato)\n");
+}
+
+/**
+ * @brief Converte "rgb,hsi,final" (ou "nenhuma") em uma combinação de MASCARA_*.
+ * @return -1 se algum nome for desconhecido.
+ */
+DETECTOR_INTERNO int ler_lista_mascaras(const char *lista) {
+    if (strcmp(lista, "nenhuma") == 0) return 0;
+    int mascaras = 0;
+    const char *p = lista;
+    while (*p) {
+        size_t n = strcspn(p, ",");
+        if (n == 3 && strncmp(p, "rgb", 3) == 0) mascaras |= MASCARA_RGB;
+        else if (n == 3 && strncmp(p, "hsi", 3) == 0) mascaras |= MASCARA_HSI;
+        else if (n == 5 && strncmp(p, "final", 5) == 0) mascaras |= MASCARA_FINAL;
+        else return -1;
+        p += n;
+        if (*p == ',') p++;
+    }
+    return mascaras;
+}
+
+/**
+ * @brief Lê as opções da linha de comando.
+ * @return false se alguma opção for inválida.
+ */
+DETECTOR_INTERNO bool ler_opcoes(int argc, char *argv[], OpcoesDetector *op) {
+    memset(op, 0, sizeof(*op));
+    op->caminho_imagem = "imagem_teste.jpg";
+    op->num_threads = numero_processadores();
+    op->tolerancia_video = -1;
+    op->mascaras = MASCARAS_TODAS;
+    op->escala = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--rapido") == 0) {
+            op->modo_rapido = true;
+        } else if (strcmp(argv[i], "--mascaras") == 0 && i + 1 < argc) {
+            op->mascaras = ler_lista_mascaras(argv[++i]);
+            if (op->mascaras < 0) return false;
+        } else if (strcmp(argv[i], "--escala") == 0 && i + 1 < argc) {
+            op->escala = atoi(argv[++i]);
+            if (op->escala != 1 && op->escala != 2 && op->escala != 4 && op->escala != 8) return false;
+        } else if ((strcmp(argv[i], "--abertura") == 0 || strcmp(argv[i], "--fechamento") == 0) && i + 1 < argc) {
+            bool abertura = argv[i][2] == 'a';
+            int *largura = abertura ? &op->limpeza.abertura_largura : &op->limpeza.fechamento_largura;
+            int *altura = abertura ? &op->limpeza.abertura_altura : &op->limpeza.fechamento_altura;
+            if (sscanf(argv[++i], "%dx%d", largura, altura) != 2 || *largura <= 0 || *altura <= 0) return false;
+        } else if (strcmp(argv[i], "--regioes") == 0) {
+            op->por_regioes = true;
+        } else if (strcmp(argv[i], "--triagem") == 0) {
+            op->triagem = true;
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            op->kernel = argv[++i];
+        } else if (strcmp(argv[i], "--tabela") == 0 && i + 1 < argc) {
+            op->caminho_tabela = argv[++i];
+            op->modo_rapido = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            op->num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--alarme") == 0) {
+            op->modo_alarme = true;
+            op->modo_rapido = true;
+        } else if (strcmp(argv[i], "--lote") == 0 && i + 1 < argc) {
+            op->entrada_lote = argv[++i];
+            op->modo_rapido = true;
+        } else if (strcmp(argv[i], "--metricas") == 0 && i + 1 < argc) {
+            op->caminho_metricas = argv[++i];
+        } else if (strcmp(argv[i], "--depurar-alocacoes") == 0) {
+            op->depurar_alocacoes = true;
+        } else if (strcmp(argv[i], "--saida") == 0 && i + 1 < argc) {
+            op->dir_saida = argv[++i];
+        } else if (strcmp(argv[i], "--video") == 0) {
+            op->tolerancia_video = 0;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+                op->tolerancia_video = atoi(argv[++i]);
+                if (op->tolerancia_video > 255) op->tolerancia_video = 255;
+            }
+        } else if (strcmp(argv[i], "--nv12") == 0) {
+            op->nv12 = true;
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &op->largura_stream, &op->altura_stream) != 2 ||
+                op->largura_stream <= 0 || op->altura_stream <= 0) {
+                return false;
+            }
+            op->modo_rapido = true;
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            op->caminho_imagem = argv[i];
+        }
+    }
+    // O modo alarme não gera a máscara que a rotulagem e a limpeza precisam
+    if ((op->por_regioes || limpeza_ativa(&op->limpeza)) && op->modo_alarme) return false;
+    // --saida só existe no lote, que só grava a máscara final
+    if (op->dir_saida && (!op->entrada_lote || !(op->mascaras & MASCARA_FINAL))) return false;
+    // As métricas são por imagem; o stream não tem imagens
+    if (op->caminho_metricas && op->largura_stream > 0) return false;
+    // NV12 só existe no stream, e o modo vídeo compara blocos RGB
+    return !(op->nv12 && (op->largura_stream == 0 || op->tolerancia_video >= 0));
+}
+
+// Sem main quando o arquivo é incluído por outro programa (benchmark_fumaca.c, fumaca.c).
+#ifndef DETECTOR_SEM_MAIN
+int main(int argc, char *argv[]) {
+    OpcoesDetector op;
+    if (!ler_opcoes(argc, argv, &op)) {
+        imprimir_uso(argv[0]);
+        return 1;
+    }
+
+    if (!selecionar_kernels(op.kernel)) {
+        printf("ERRO: Kernel '%s' desconhecido ou não suportado por esta CPU.\n", op.kernel);
+        return 1;
+    }
+
+    TabelaFumaca tabela = {0};
+    if (op.caminho_tabela && !tabela_carregar_ou_construir(&tabela, op.caminho_tabela, &LIMIARES_PADRAO)) {
+        printf("ERRO: Não foi possível construir a tabela de consulta.\n");
+        return 1;
+    }
+    const TabelaFumaca *tabela_ativa = op.caminho_tabela ? &tabela : NULL;
+    float deteccao_threshold = 0.2; // Limiar: alerta se mais de 0.2% da imagem for fumaça.
+
+    FILE *saida_metricas = NULL;
+    if (op.caminho_metricas) {
+        saida_metricas = strcmp(op.caminho_metricas, "-") == 0 ? stderr : fopen(op.caminho_metricas, "a");
+        if (!saida_metricas) {
+            printf("ERRO: Não foi possível abrir '%s' para as métricas.\n", op.caminho_metricas);
+            tabela_liberar(&tabela);
+            return 1;
+        }
+    }
+
+    if (op.largura_stream > 0) {
+        TabelaYuv tabela_yuv = {NULL, 256};
+        if (op.nv12 && !tabela_yuv_construir(&tabela_yuv, &LIMIARES_PADRAO)) {
+            printf("ERRO: Não foi possível construir a tabela YUV.\n");
+            tabela_liberar(&tabela);
+            return 1;
+        }
+        PoolThreads *pool = pool_criar(op.num_threads);
+        Classificador classificador = {&LIMIARES_PADRAO, tabela_ativa};
+        executar_stream(op.largura_stream, op.altura_stream, pool, &classificador, op.nv12 ? &tabela_yuv : NULL,
+                        op.modo_alarme, op.tolerancia_video, deteccao_threshold);
+        pool_destruir(pool);
+        tabela_yuv_liberar(&tabela_yuv);
+        tabela_liberar(&tabela);
+        return 0;
+    }
+
+    if (op.entrada_lote) {
+        PoolThreads *pool = pool_criar(op.num_threads);
+        Classificador classificador = {&LIMIARES_PADRAO, tabela_ativa};
+        int erros = executar_lote(op.entrada_lote, op.dir_saida, op.escala, op.triagem, &op.limpeza,
+                                  op.por_regioes, pool, &classificador, op.modo_alarme,
+                                  op.depurar_alocacoes, saida_metricas, deteccao_threshold);
+        pool_destruir(pool);
+        tabela_liberar(&tabela);
+        if (saida_metricas && saida_metricas != stderr) fclose(saida_metricas);
+        return erros > 0 ? 1 : 0;
+    }
+
+    MetricasImagem metricas_imagem;
+    MetricasImagem *metricas = saida_metricas ? &metricas_imagem : NULL;
+    if (metricas) {
+        metricas_iniciar(metricas);
+        metricas->bytes_lidos = tamanho_arquivo(op.caminho_imagem);
+    }
+
+    TriagemMiniatura triagem;
+    MarcaTempo inicio = metricas_marcar(metricas, NULL);
+    bool triada = op.triagem && triar_miniatura(op.caminho_imagem, deteccao_threshold, &triagem);
+    if (op.triagem) metricas_registrar(metricas, ETAPA_TRIAGEM, &inicio, NULL);
+    if (triada) {
+        printf("Triagem: %ld de %ld blocos 8x8 candidatos (%.4f%%)", triagem.blocos_candidatos, triagem.blocos,
+               100.0f * triagem.blocos_candidatos / triagem.blocos);
+        if (!triagem.suspeita) {
+            printf("; análise completa dispensada.\n");
+            printf("\n========================================================\n");
+            printf(">>> Nenhum sinal significativo de fumaça detectado. <<<\n");
+            printf("========================================================\n");
+            if (metricas) {
+                metricas_escrever_json(saida_metricas, op.caminho_imagem, 0, 0, metricas);
+                if (saida_metricas != stderr) fclose(saida_metricas);
+            }
+            tabela_liberar(&tabela);
+            printf("\nProcesso concluído.\n");
+            return 0;
+        }
+        printf("; seguindo para a análise completa.\n");
+    }
+
+    // O motor fundido sempre recebe RGB (3 canais), mesmo de imagens em tons de cinza;
+    // a decodificação reduzida também sempre produz RGB
+    int width, height, channels = 3;
+    inicio = metricas_marcar(metricas, NULL);
+    unsigned char *data = op.escala > 1
+        ? carregar_rgb_reduzido(op.caminho_imagem, op.escala, &width, &height)
+        : stbi_load(op.caminho_imagem, &width, &height, &channels, op.modo_rapido ? 3 : 0);
+    metricas_registrar(metricas, ETAPA_DECODIFICAR, &inicio, NULL);
+    if (data == NULL) {
+        printf("ERRO: Não foi possível carregar a imagem.\n");
+        printf("Verifique se '%s' está na mesma pasta do executável.\n", op.caminho_imagem);
+        return 1;
+    }
+    Image img = {data, width, height, op.modo_rapido ? 3 : channels};
+    printf("Imagem '%s' carregada: %d x %d, Canais: %d", op.caminho_imagem, img.width, img.height, img.channels);
+    if (op.escala > 1) printf(" (escala 1/%d)", op.escala);
+    printf("\n\n");
+
+    PoolThreads *pool = op.modo_rapido || op.por_regioes ? pool_criar(op.num_threads) : NULL;
+    GravadorMascaras gravador;
+    gravador_iniciar(&gravador, metricas);
+    bool fumaca_detectada;
+    if (op.modo_alarme) {
+        fumaca_detectada = executar_pipeline_alarme(&img, pool, tabela_ativa, deteccao_threshold, metricas);
+    } else if (op.modo_rapido) {
+        fumaca_detectada = executar_pipeline_fundido(&img, pool, tabela_ativa, &gravador, op.mascaras,
+                                                     &op.limpeza, op.por_regioes, deteccao_threshold, metricas);
+    } else {
+        fumaca_detectada = executar_pipeline_completo(&img, pool, &gravador, op.mascaras, &op.limpeza,
+                                                      op.por_regioes, deteccao_threshold, metricas);
+    }
+    pool_destruir(pool);
+
+    if (fumaca_detectada) {
+        printf("\n=======================================================\n");
+        printf(">>> ALERTA: Possível foco de fumaça detectado! <<<\n");
+        printf("=======================================================\n");
+    } else {
+        printf("\n========================================================\n");
+        printf(">>> Nenhum sinal significativo de fumaça detectado. <<<\n");
+        printf("========================================================\n");
+    }
+    fflush(stdout);
+
+    // O veredito já saiu; agora espera as máscaras terminarem de ser gravadas
+    gravador_finalizar(&gravador);
+    if (metricas) {
+        metricas_escrever_json(saida_metricas, op.caminho_imagem, img.width, img.height, metricas);
+        if (saida_metricas != stderr) fclose(saida_metricas);
+    }
+
+    // Liberar a memória da imagem carregada
+    stbi_image_free(img.data);
+    tabela_liberar(&tabela);
+    
+    printf("\nProcesso concluído.\n");
+    return 0;
+}
+#endif // DETECTOR_SEM_MAIN
@@ -5,102 +5,709 @@
 #include <math.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 // Estrutura para armazenar estatísticas dos pixels
 typedef struct {
     double min, max, mean, std_dev;
 } ChannelStats;
 
-// Estrutura para acumular valores do algoritmo de Welford
+// Chaves inteiras dos histogramas HSI. Com a definição de hsi_vetorial.h:
+//   - I * 255 = (R + G + B) / 3 só depende da soma (0 a 765);
+//   - S = 1 - 3 * min / soma só depende do mínimo e da soma;
+//   - H só depende de R - G e R - B (G - B = (R - B) - (R - G)). H só é
+//     zerado por S <= 0.001 quando R = G = B, e aí o denominador já é zero.
+// Cada chave corresponde a um único valor de H, S ou I, então os histogramas
+// dão média e desvio padrão exatos sem converter nenhum pixel para HSI.
+#define SUM_KEYS 766
+#define SATURATION_KEYS (256 * SUM_KEYS)
+#define DIFF_KEYS 511
+#define HUE_KEYS (DIFF_KEYS * DIFF_KEYS)
+
+// Histogramas de contagem por canal
 typedef struct {
-    long long count;
-    double mean, m2;
-} Welford;
+    unsigned long long rgb[3][256];
+    unsigned long long hue[HUE_KEYS];        // (R - G + 255) * 511 + (R - B + 255)
+    unsigned long long saturation[SATURATION_KEYS]; // min * 766 + soma
+    unsigned long long intensity[SUM_KEYS];  // soma
+} Histograms;
 
-void update_welford(Welford *w, double value) {
-    w->count++;
-    double delta = value - w->mean;
-    w->mean += delta / w->count;
-    double delta2 = value - w->mean;
-    w->m2 += delta * delta2;
+void merge_histograms(Histograms *dest, const Histograms *src) {
+    const unsigned long long *from = (const unsigned long long *)src;
+    unsigned long long *to = (unsigned long long *)dest;
+    for (size_t k = 0; k < sizeof(Histograms) / sizeof(unsigned long long); k++) {
+        to[k] += from[k];
+    }
 }
 
-double finalize_std_dev(Welford *w) {
-    return sqrt(w->m2 / w->count);
+// Soma 'n' pixels RGB consecutivos aos histogramas
+static inline void accumulate_pixels(Histograms *hist, const unsigned char *pixel, size_t n) {
+    const unsigned char *end = pixel + n * 3;
+    for (; pixel < end; pixel += 3) {
+        int r = pixel[0], g = pixel[1], b = pixel[2];
+        int sum = r + g + b;
+        int min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+
+        hist->rgb[0][r]++;
+        hist->rgb[1][g]++;
+        hist->rgb[2][b]++;
+        hist->hue[(r - g + 255) * DIFF_KEYS + (r - b + 255)]++;
+        hist->saturation[min * SUM_KEYS + sum]++;
+        hist->intensity[sum]++;
+    }
 }
 
-void rgb_to_hsi(double r, double g, double b, double *h, double *s, double *i) {
-    r /= 255.0; g /= 255.0; b /= 255.0;
-    
-    double max = fmax(r, fmax(g, b));
-    double min = fmin(r, fmin(g, b));
-    double delta = max - min;
-    
-    *i = (r + g + b) / 3.0;
-    
-    if (delta == 0) {
-        *h = 0;
-        *s = 0;
-    } else {
-        *s = 1 - min / *i;
-        
-        if (max == r) {
-            *h = fmod(60 * ((g - b) / delta) + 360, 360);
-        } else if (max == g) {
-            *h = 60 * ((b - r) / delta + 2);
-        } else {
-            *h = 60 * ((r - g) / delta + 4);
-        }
+// Caminho da anotação de 'filename': <mask_dir>/<nome sem extensão>.png
+static void annotation_path(const char *filename, const char *mask_dir, char *out, size_t size) {
+    const char *name = strrchr(filename, '/');
+    name = name ? name + 1 : filename;
+    const char *dot = strrchr(name, '.');
+    int len = dot ? (int)(dot - name) : (int)strlen(name);
+    snprintf(out, size, "%s/%.*s.png", mask_dir, len, name);
+}
+
+// Próximo trecho de pixels marcados (máscara != 0) da linha a partir de 'x'.
+// Devolve o início (ou -1 se não houver mais) e grava o fim em 'run_end'.
+// Os zeros são pulados de 8 em 8 bytes.
+static int next_run(const unsigned char *mask, int width, int x, int *run_end) {
+    for (; x + 8 <= width; x += 8) {
+        uint64_t word;
+        memcpy(&word, mask + x, sizeof(word));
+        if (word) break;
     }
+    while (x < width && !mask[x]) x++;
+    if (x >= width) return -1;
+    int end = x;
+    while (end < width && mask[end]) end++;
+    *run_end = end;
+    return x;
 }
 
-void process_image(const char *filename, Welford rgb_stats[3], Welford hsi_stats[3]) {
+// Acumula uma imagem. Com 'mask_dir', só os pixels marcados na anotação
+// (PNG de mesmo nome em 'mask_dir', qualquer valor diferente de 0 é fumaça)
+// entram nos histogramas; imagens sem anotação nem são decodificadas.
+int process_image(const char *filename, const char *mask_dir, Histograms *hist) {
     int width, height, channels;
+    unsigned char *mask = NULL;
+    int mask_width = 0, mask_height = 0;
+
+    if (mask_dir != NULL) {
+        char path[2048];
+        annotation_path(filename, mask_dir, path, sizeof(path));
+        mask = stbi_load(path, &mask_width, &mask_height, &channels, 1);
+        if (!mask) {
+            printf("Sem anotação, ignorada: %s\n", filename);
+            return 0;
+        }
+    }
+
     unsigned char *image = stbi_load(filename, &width, &height, &channels, 3);
     
     if (!image) {
         printf("Erro ao carregar imagem: %s\n", filename);
+        stbi_image_free(mask);
+        return 0;
+    }
+
+    if (mask == NULL) {
+        accumulate_pixels(hist, image, (size_t)width * height);
+    } else if (mask_width != width || mask_height != height) {
+        printf("Anotação com dimensões diferentes da imagem, ignorada: %s\n", filename);
+    } else {
+        for (int y = 0; y < height; y++) {
+            const unsigned char *mask_row = mask + (size_t)y * width;
+            const unsigned char *row = image + (size_t)y * width * 3;
+            int x = 0, end;
+            while ((x = next_run(mask_row, width, x, &end)) >= 0) {
+                accumulate_pixels(hist, row + (size_t)x * 3, end - x);
+                x = end;
+            }
+        }
+    }
+
+    stbi_image_free(mask);
+    stbi_image_free(image);
+    return 1;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Lista os arquivos regulares de 'dir_path' em ordem alfabética
+char **list_images(const char *dir_path, int *count) {
+    DIR *dir;
+    struct dirent *entry;
+    char path[1024];
+
+    *count = 0;
+    if ((dir = opendir(dir_path)) == NULL) {
+        perror("Erro ao abrir diretório");
+        return NULL;
+    }
+
+    int capacity = 64;
+    char **files = (char **)malloc(sizeof(char *) * capacity);
+    while (files && (entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_REG) {
+            if (*count == capacity) {
+                capacity *= 2;
+                char **grown = (char **)realloc(files, sizeof(char *) * capacity);
+                if (!grown) break;
+                files = grown;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            files[(*count)++] = strdup(path);
+        }
+    }
+    closedir(dir);
+
+    if (files) qsort(files, *count, sizeof(char *), compare_paths);
+    return files;
+}
+
+// Cache de estatísticas por imagem (--cache). Cada entrada guarda a chave
+// da imagem (caminho, tamanho, mtime e hash FNV-1a do conteúdo, continuado
+// pelo da anotação quando houver) e os histogramas da imagem em formato
+// esparso: o número de posições não nulas e, para cada uma, a distância até
+// a posição anterior e a contagem, em varints. Formato do arquivo:
+//   "FUMCACHE" | u32 versão | u32 posições dos histogramas | entradas até o fim
+//   entrada: u16 bytes do caminho | caminho | u64 tamanho | i64 mtime (ns) |
+//            u64 hash | u64 bytes do parcial | u64 FNV-1a do parcial | parcial
+// com inteiros little-endian. Uma imagem que não pôde ser decodificada é
+// guardada com um parcial de 0 bytes, para não ser tentada de novo enquanto
+// não mudar (um parcial válido tem sempre pelo menos 1 byte). O arquivo antigo é mapeado na memória, então
+// os parciais em cache não são copiados nem lidos além do necessário.
+#define CACHE_MAGIC "FUMCACHE"
+#define CACHE_VERSION 1
+#define HISTOGRAM_WORDS (sizeof(Histograms) / sizeof(unsigned long long))
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+    const char *path;              // Sem '\0' no fim quando aponta para o arquivo mapeado
+    int path_len;
+    unsigned long long size;
+    long long mtime_ns;
+    uint64_t hash;
+    const unsigned char *partial;  // Histogramas esparsos (NULL = imagem não analisada)
+    size_t partial_size;
+    uint64_t partial_hash;         // Só no cache lido: confere o parcial antes de usá-lo
+    int allocated;                 // O parcial foi gerado nesta execução (liberar)
+    int failed;                    // A imagem não pôde ser decodificada (sem parcial)
+} CacheEntry;
+
+typedef struct {
+    unsigned char *map;            // Arquivo de cache anterior mapeado (NULL se não houver)
+    size_t map_size;
+    CacheEntry *entries;           // Em ordem de caminho
+    int count;
+} StatsCache;
+
+typedef struct {
+    unsigned char *data;
+    size_t size, capacity;
+} ByteBuffer;
+
+static int buffer_put(ByteBuffer *buf, const void *data, size_t n) {
+    if (buf->size + n > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + n) capacity *= 2;
+        unsigned char *grown = (unsigned char *)realloc(buf->data, capacity);
+        if (!grown) return 0;
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, n);
+    buf->size += n;
+    return 1;
+}
+
+static int buffer_put_varint(ByteBuffer *buf, unsigned long long value) {
+    unsigned char bytes[10];
+    int n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n++;
+    } while (value);
+    return buffer_put(buf, bytes, n);
+}
+
+// Lê um varint; devolve NULL se os bytes acabarem ou o valor não couber em 64 bits
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, unsigned long long *value) {
+    *value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        *value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return p;
+    }
+    return NULL;
+}
+
+static void put_u64(unsigned char *out, unsigned long long value, int bytes) {
+    for (int k = 0; k < bytes; k++) out[k] = (unsigned char)(value >> (8 * k));
+}
+
+static unsigned long long get_u64(const unsigned char *in, int bytes) {
+    unsigned long long value = 0;
+    for (int k = 0; k < bytes; k++) value |= (unsigned long long)in[k] << (8 * k);
+    return value;
+}
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *data, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        hash ^= data[k];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Continua o hash FNV-1a de 64 bits '*hash' com o conteúdo do arquivo
+static int hash_file(const char *path, uint64_t *hash) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned char chunk[65536];
+    size_t n;
+    uint64_t h = *hash;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) h = fnv1a(h, chunk, n);
+    int ok = !ferror(f);
+    fclose(f);
+    *hash = h;
+    return ok;
+}
+
+// Codifica os histogramas de uma imagem em formato esparso e os zera, para
+// que 'hist' sirva para a próxima imagem sem percorrer os 3,7 MB de novo
+unsigned char *encode_partial(Histograms *hist, size_t *size) {
+    unsigned long long *words = (unsigned long long *)hist;
+    unsigned long long used = 0;
+    for (size_t k = 0; k < HISTOGRAM_WORDS; k++) used += words[k] != 0;
+
+    ByteBuffer buf = {0};
+    int ok = buffer_put_varint(&buf, used);
+    size_t previous = 0;
+    for (size_t k = 0; k < HISTOGRAM_WORDS; k++) {
+        if (words[k]) {
+            ok = ok && buffer_put_varint(&buf, k - previous) && buffer_put_varint(&buf, words[k]);
+            previous = k;
+            words[k] = 0;
+        }
+    }
+    if (!ok) {
+        free(buf.data);
+        return NULL;
+    }
+    *size = buf.size;
+    return buf.data;
+}
+
+// Soma um parcial esparso a 'hist'. Confere o parcial inteiro antes de somar:
+// um cache corrompido nunca altera 'hist' (devolve 0 e a imagem é reprocessada).
+int merge_partial(Histograms *hist, const unsigned char *data, size_t size) {
+    const unsigned char *end = data + size;
+    for (int apply = 0; apply < 2; apply++) {
+        unsigned long long *words = (unsigned long long *)hist;
+        unsigned long long used, delta, count;
+        unsigned long long position = 0;
+        const unsigned char *p = get_varint(data, end, &used);
+        if (!p || used > HISTOGRAM_WORDS) return 0;
+        for (unsigned long long k = 0; k < used; k++) {
+            if (!(p = get_varint(p, end, &delta)) || !(p = get_varint(p, end, &count))) return 0;
+            position += delta;
+            if ((k > 0 && delta == 0) || position >= HISTOGRAM_WORDS) return 0;
+            if (apply) words[position] += count;
+        }
+        if (p != end) return 0;
+    }
+    return 1;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const CacheEntry *ea = (const CacheEntry *)a, *eb = (const CacheEntry *)b;
+    int len = ea->path_len < eb->path_len ? ea->path_len : eb->path_len;
+    int c = memcmp(ea->path, eb->path, len);
+    return c ? c : (ea->path_len > eb->path_len) - (ea->path_len < eb->path_len);
+}
+
+// Carrega o cache de 'path'. Um arquivo ausente, de outra versão ou truncado
+// não é erro: as entradas que não puderem ser lidas são reprocessadas.
+void cache_load(StatsCache *cache, const char *path) {
+    memset(cache, 0, sizeof(*cache));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16) {
+        close(fd);
         return;
     }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    cache->map = (unsigned char *)map;
+    cache->map_size = (size_t)st.st_size;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * 3;
-            unsigned char r = image[idx];
-            unsigned char g = image[idx + 1];
-            unsigned char b = image[idx + 2];
+    const unsigned char *p = cache->map, *end = cache->map + cache->map_size;
+    if (memcmp(p, CACHE_MAGIC, 8) != 0 || get_u64(p + 8, 4) != CACHE_VERSION ||
+        get_u64(p + 12, 4) != HISTOGRAM_WORDS) {
+        printf("Cache de outra versão ignorado: %s\n", path);
+        return;
+    }
+    p += 16;
 
-            // Atualiza estatísticas RGB
-            update_welford(&rgb_stats[0], r);
-            update_welford(&rgb_stats[1], g);
-            update_welford(&rgb_stats[2], b);
+    int capacity = 0;
+    while (end - p >= 2) {
+        size_t path_len = get_u64(p, 2);
+        if ((size_t)(end - p) < 2 + path_len + 40) break;
+        const unsigned char *fields = p + 2 + path_len;
+        size_t partial_size = get_u64(fields + 24, 8);
+        if (partial_size > (size_t)(end - fields - 40)) break;
 
-            // Converte para HSI
-            double h, s, i_val;
-            rgb_to_hsi(r, g, b, &h, &s, &i_val);
+        if (cache->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            CacheEntry *grown = (CacheEntry *)realloc(cache->entries, sizeof(CacheEntry) * capacity);
+            if (!grown) break;
+            cache->entries = grown;
+        }
+        CacheEntry *e = &cache->entries[cache->count++];
+        e->path = (const char *)(p + 2);
+        e->path_len = (int)path_len;
+        e->size = get_u64(fields, 8);
+        e->mtime_ns = (long long)get_u64(fields + 8, 8);
+        e->hash = get_u64(fields + 16, 8);
+        e->partial_hash = get_u64(fields + 32, 8);
+        e->partial = fields + 40;
+        e->partial_size = partial_size;
+        e->allocated = 0;
+        e->failed = partial_size == 0;
+        p = fields + 40 + partial_size;
+    }
+    if (cache->entries) qsort(cache->entries, cache->count, sizeof(CacheEntry), compare_entries);
+}
 
-            // Atualiza estatísticas HSI
-            update_welford(&hsi_stats[0], h);
-            update_welford(&hsi_stats[1], s);
-            update_welford(&hsi_stats[2], i_val * 255);
+const CacheEntry *cache_find(const StatsCache *cache, const char *path) {
+    if (cache->count == 0) return NULL;
+    CacheEntry key = {0};
+    key.path = path;
+    key.path_len = (int)strlen(path);
+    return (const CacheEntry *)bsearch(&key, cache->entries, cache->count, sizeof(CacheEntry), compare_entries);
+}
+
+void cache_close(StatsCache *cache) {
+    if (cache->map) munmap(cache->map, cache->map_size);
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Grava as entradas analisadas em 'path' (via arquivo temporário + rename,
+// para que uma interrupção não deixe um cache pela metade). O temporário leva
+// o PID, para que duas execuções sobre o mesmo cache não escrevam no mesmo arquivo.
+int cache_save(const char *path, const CacheEntry *entries, int count) {
+    char tmp_path[2048];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return 0;
+
+    unsigned char header[40];
+    memcpy(header, CACHE_MAGIC, 8);
+    put_u64(header + 8, CACHE_VERSION, 4);
+    put_u64(header + 12, HISTOGRAM_WORDS, 4);
+    int ok = fwrite(header, 1, 16, f) == 16;
+    for (int i = 0; ok && i < count; i++) {
+        const CacheEntry *e = &entries[i];
+        if ((e->partial == NULL && !e->failed) || e->path_len > 0xffff) continue;
+        put_u64(header, e->path_len, 2);
+        ok = fwrite(header, 1, 2, f) == 2 && fwrite(e->path, 1, e->path_len, f) == (size_t)e->path_len;
+        put_u64(header, e->size, 8);
+        put_u64(header + 8, (unsigned long long)e->mtime_ns, 8);
+        put_u64(header + 16, e->hash, 8);
+        put_u64(header + 24, e->partial_size, 8);
+        put_u64(header + 32, fnv1a(FNV_OFFSET, e->partial, e->partial_size), 8);
+        ok = ok && fwrite(header, 1, 40, f) == 40 &&
+             (e->partial_size == 0 || fwrite(e->partial, 1, e->partial_size, f) == e->partial_size);
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Fila de imagens compartilhada pelas threads: cada uma pega o próximo
+// índice livre e acumula a imagem nos seus próprios histogramas
+typedef struct {
+    char **files;
+    int count;
+    const char *mask_dir;
+    const StatsCache *cache;  // NULL sem --cache
+    CacheEntry *fresh;        // Com --cache: entrada nova de cada arquivo
+    atomic_int next;
+    atomic_int cached;
+    Histograms *total;
+    pthread_mutex_t lock;
+} ExtractionJob;
+
+// Com --cache: usa o parcial em cache da imagem se a chave bater, ou analisa
+// a imagem em 'scratch' e guarda o parcial novo em job->fresh[i]
+static void process_cached(ExtractionJob *job, int i, Histograms *hist, Histograms *scratch) {
+    const char *path = job->files[i];
+    CacheEntry *entry = &job->fresh[i];
+    struct stat st;
+    uint64_t hash = FNV_OFFSET;
+
+    if (stat(path, &st) != 0 || !hash_file(path, &hash)) {
+        printf("Erro ao carregar imagem: %s\n", path);
+        return;
+    }
+    if (job->mask_dir != NULL) {
+        char mask_path[2048];
+        annotation_path(path, job->mask_dir, mask_path, sizeof(mask_path));
+        if (!hash_file(mask_path, &hash)) {
+            printf("Sem anotação, ignorada: %s\n", path);
+            return;
         }
     }
+    entry->path = path;
+    entry->path_len = (int)strlen(path);
+    entry->size = (unsigned long long)st.st_size;
+    entry->mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    entry->hash = hash;
 
-    stbi_image_free(image);
+    const CacheEntry *old = cache_find(job->cache, path);
+    if (old && old->failed && old->size == entry->size && old->mtime_ns == entry->mtime_ns &&
+        old->hash == entry->hash && old->partial_hash == FNV_OFFSET) {
+        printf("Não decodificável (em cache), ignorada: %s\n", path);
+        entry->failed = 1;
+        atomic_fetch_add(&job->cached, 1);
+        return;
+    }
+    if (old && !old->failed && old->size == entry->size && old->mtime_ns == entry->mtime_ns && old->hash == entry->hash &&
+        fnv1a(FNV_OFFSET, old->partial, old->partial_size) == old->partial_hash &&
+        merge_partial(hist, old->partial, old->partial_size)) {
+        entry->partial = old->partial;
+        entry->partial_size = old->partial_size;
+        atomic_fetch_add(&job->cached, 1);
+        return;
+    }
+
+    printf("Processando: %s\n", path);
+    if (!process_image(path, job->mask_dir, scratch)) {
+        entry->failed = 1;
+        return;
+    }
+    unsigned char *partial = encode_partial(scratch, &entry->partial_size);
+    if (!partial) {
+        printf("Erro: memória insuficiente para o cache de %s\n", path);
+        memset(scratch, 0, sizeof(Histograms));
+        return;
+    }
+    merge_partial(hist, partial, entry->partial_size);
+    entry->partial = partial;
+    entry->allocated = 1;
 }
 
-void calculate_thresholds(Welford stats[3], ChannelStats thresholds[3]) {
-    for (int i = 0; i < 3; i++) {
-        thresholds[i].mean = stats[i].mean;
-        thresholds[i].std_dev = finalize_std_dev(&stats[i]);
-        thresholds[i].min = stats[i].mean - 2 * thresholds[i].std_dev;
-        thresholds[i].max = stats[i].mean + 2 * thresholds[i].std_dev;
+static void *extraction_worker(void *arg) {
+    ExtractionJob *job = (ExtractionJob *)arg;
+    Histograms *hist = (Histograms *)calloc(1, sizeof(Histograms));
+    Histograms *scratch = job->cache ? (Histograms *)calloc(1, sizeof(Histograms)) : NULL;
+    if (!hist || (job->cache && !scratch)) {
+        printf("Erro: memória insuficiente\n");
+        free(scratch);
+        free(hist);
+        return NULL;
+    }
+
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        if (job->cache) {
+            process_cached(job, i, hist, scratch);
+        } else {
+            printf("Processando: %s\n", job->files[i]);
+            process_image(job->files[i], job->mask_dir, hist);
+        }
+    }
+
+    // Contagens inteiras: a ordem em que as threads terminam não muda o total
+    pthread_mutex_lock(&job->lock);
+    merge_histograms(job->total, hist);
+    pthread_mutex_unlock(&job->lock);
+    free(scratch);
+    free(hist);
+    return NULL;
+}
+
+// Processa as imagens com 'num_threads' threads, somando tudo em 'total'.
+// Com 'cache_path', reaproveita os parciais das imagens que não mudaram e
+// regrava o cache só com as imagens presentes no diretório.
+void process_images(char **files, int count, const char *mask_dir, const char *cache_path, int num_threads,
+                    Histograms *total) {
+    StatsCache cache;
+    CacheEntry *fresh = NULL;
+    if (cache_path != NULL) {
+        cache_load(&cache, cache_path);
+        fresh = (CacheEntry *)calloc(count > 0 ? count : 1, sizeof(CacheEntry));
+        if (!fresh) {
+            printf("Erro: memória insuficiente\n");
+            cache_close(&cache);
+            return;
+        }
+    }
+
+    ExtractionJob job = {files, count, mask_dir, fresh ? &cache : NULL, fresh, 0, 0, total,
+                         PTHREAD_MUTEX_INITIALIZER};
+    if (num_threads > count) num_threads = count;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * (num_threads > 1 ? num_threads : 1));
+    int started = 0;
+    if (threads) {
+        for (; started < num_threads - 1; started++) {
+            if (pthread_create(&threads[started], NULL, extraction_worker, &job) != 0) break;
+        }
+    }
+    // A thread principal também trabalha (e sozinha termina a fila se nenhuma thread subir)
+    extraction_worker(&job);
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    free(threads);
+
+    if (fresh) {
+        printf("Imagens reaproveitadas do cache: %d de %d\n", atomic_load(&job.cached), count);
+        if (!cache_save(cache_path, fresh, count)) {
+            printf("Erro ao gravar o cache: %s\n", cache_path);
+        }
+        for (int i = 0; i < count; i++) {
+            if (fresh[i].allocated) free((void *)fresh[i].partial);
+        }
+        free(fresh);
+        cache_close(&cache);
+    }
+}
+
+// Posição de um histograma: o valor da chave e quantos pixels caíram nela
+typedef struct {
+    double value;
+    unsigned long long count;
+} HistogramBin;
+
+static int compare_bins(const void *a, const void *b) {
+    double va = ((const HistogramBin *)a)->value, vb = ((const HistogramBin *)b)->value;
+    return (va > vb) - (va < vb);
+}
+
+// Percentil 'p' (0-100) pela definição do posto mais próximo: o menor valor
+// com pelo menos ceil(p / 100 * total) pixels até ele. 'bins' em ordem de valor.
+static double bins_quantile(const HistogramBin *bins, int used, unsigned long long total, double p) {
+    unsigned long long rank = (unsigned long long)ceil(p / 100.0 * total);
+    if (rank < 1) rank = 1;
+    unsigned long long seen = 0;
+    for (int k = 0; k < used; k++) {
+        seen += bins[k].count;
+        if (seen >= rank) return bins[k].value;
+    }
+    return bins[used - 1].value;
+}
+
+// Estatísticas de um histograma cujas chaves valem values[k]: média e desvio
+// padrão em duas passadas, e Min/Max nos percentis 'low' e 'high'. Os
+// percentis são exatos, porque cada chave tem um único valor.
+int histogram_stats(const unsigned long long *hist, const double *values, int keys, double low, double high,
+                    ChannelStats *out) {
+    int used = 0;
+    for (int k = 0; k < keys; k++) {
+        if (hist[k]) used++;
+    }
+    if (used == 0) {
+        out->min = out->max = out->mean = out->std_dev = NAN;
+        return 1;
+    }
+    HistogramBin *bins = (HistogramBin *)malloc(sizeof(HistogramBin) * used);
+    if (!bins) return 0;
+
+    unsigned long long count = 0;
+    double sum = 0.0;
+    used = 0;
+    for (int k = 0; k < keys; k++) {
+        if (hist[k]) {
+            bins[used].value = values[k];
+            bins[used].count = hist[k];
+            used++;
+            count += hist[k];
+            sum += (double)hist[k] * values[k];
+        }
+    }
+    double mean = sum / count;
+    double m2 = 0.0;
+    for (int k = 0; k < used; k++) {
+        double delta = bins[k].value - mean;
+        m2 += (double)bins[k].count * delta * delta;
+    }
+
+    // H e S não crescem com a chave; R, G, B e I já estão em ordem
+    qsort(bins, used, sizeof(HistogramBin), compare_bins);
+    out->mean = mean;
+    out->std_dev = sqrt(m2 / count);
+    out->min = bins_quantile(bins, used, count, low);
+    out->max = bins_quantile(bins, used, count, high);
+    free(bins);
+    return 1;
+}
+
+// Valor de H (graus) da chave (R - G, R - B), em precisão dupla
+static double hue_of_key(int rg, int rb) {
+    int gb = rb - rg;
+    double num = 0.5 * (rg + rb);
+    double den = sqrt((double)rg * rg + (double)rb * gb);
+    if (den == 0.0) return 0.0;
+    double ratio = num / den;
+    if (ratio > 1.0) ratio = 1.0;
+    if (ratio < -1.0) ratio = -1.0;
+    double theta = acos(ratio) * (180.0 / M_PI);
+    return gb < 0 ? 360.0 - theta : theta;
+}
+
+// Limiares de cada canal nos percentis 'low' e 'high'
+int calculate_thresholds(const Histograms *hist, double low, double high, ChannelStats rgb_thresholds[3],
+                         ChannelStats hsi_thresholds[3]) {
+    double *values = (double *)malloc(sizeof(double) * HUE_KEYS);
+    if (!values) return 0;
+
+    for (int k = 0; k < 256; k++) values[k] = k;
+    int ok = 1;
+    for (int i = 0; i < 3; i++) ok &= histogram_stats(hist->rgb[i], values, 256, low, high, &rgb_thresholds[i]);
+
+    for (int rg = -255; rg <= 255; rg++) {
+        for (int rb = -255; rb <= 255; rb++) {
+            values[(rg + 255) * DIFF_KEYS + (rb + 255)] = hue_of_key(rg, rb);
+        }
     }
+    ok &= histogram_stats(hist->hue, values, HUE_KEYS, low, high, &hsi_thresholds[0]);
+
+    for (int min = 0; min < 256; min++) {
+        for (int sum = 0; sum < SUM_KEYS; sum++) {
+            values[min * SUM_KEYS + sum] = sum > 0 ? 1.0 - 3.0 * min / sum : 0.0;
+        }
+    }
+    ok &= histogram_stats(hist->saturation, values, SATURATION_KEYS, low, high, &hsi_thresholds[1]);
+
+    for (int sum = 0; sum < SUM_KEYS; sum++) values[sum] = sum / 3.0;
+    ok &= histogram_stats(hist->intensity, values, SUM_KEYS, low, high, &hsi_thresholds[2]);
+
+    free(values);
+    return ok;
 }
 
 void save_thresholds_to_csv(ChannelStats rgb_thresholds[3], ChannelStats hsi_thresholds[3], const char *output_dir) {
@@ -153,48 +760,93 @@ void save_thresholds_to_csv(ChannelStats rgb_thresholds[3], ChannelStats hsi_thr
     printf("Arquivo CSV salvo: %s\n", full_path);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2 || argc > 3) {
-        printf("Uso: %s <diretorio_imagens> [diretorio_saida]\n", argv[0]);
-        printf("Exemplo: %s ./imagens_fumaca ./resultados\n", argv[0]);
-        return 1;
-    }
+// Sem main quando o arquivo é incluído por outro programa (testes/teste_cache_extracao.c).
+#ifndef EXTRACAO_SEM_MAIN
+static void print_usage(const char *program) {
+    printf("Uso: %s <diretorio_imagens> [diretorio_saida] [-j N] [--quantis B,A] [--anotacoes DIR] [--cache ARQ]\n",
+           program);
+    printf("  -j N           Processa N imagens em paralelo (padrão: número de CPUs)\n");
+    printf("  --quantis B,A  Min e Max de cada canal nos percentis B e A (padrão: 2,98)\n");
+    printf("  --anotacoes D  Só usa os pixels marcados nas máscaras PNG de mesmo nome em D\n");
+    printf("  --cache ARQ    Guarda as estatísticas de cada imagem em ARQ e só analisa as novas ou alteradas\n");
+    printf("Exemplo: %s ./imagens_fumaca ./resultados -j 8\n", program);
+}
 
-    const char *output_dir = (argc == 3) ? argv[2] : ".";
+int main(int argc, char *argv[]) {
+    const char *input_dir = NULL;
+    const char *output_dir = ".";
+    const char *mask_dir = NULL;
+    const char *cache_path = NULL;
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double low = 2.0, high = 98.0;
+    int positional = 0;
 
-    if (argc != 2) {
-        printf("Uso: %s <diretorio_imagens>\n", argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                printf("Erro: -j espera um número de threads positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--quantis") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf,%lf", &low, &high) != 2 || low < 0 || high > 100 || low >= high) {
+                printf("Erro: --quantis espera dois percentis crescentes entre 0 e 100 (ex.: 2,98)\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--anotacoes") == 0 && i + 1 < argc) {
+            mask_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if (argv[i][0] != '-' && positional == 0) {
+            input_dir = argv[i];
+            positional++;
+        } else if (argv[i][0] != '-' && positional == 1) {
+            output_dir = argv[i];
+            positional++;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (input_dir == NULL) {
+        print_usage(argv[0]);
         return 1;
     }
+    if (num_threads < 1) num_threads = 1;
 
-    DIR *dir;
-    struct dirent *entry;
-    char path[1024];
-    
-    Welford rgb_stats[3] = {0};
-    Welford hsi_stats[3] = {0};
-    
     ChannelStats rgb_thresholds[3], hsi_thresholds[3];
 
-    if ((dir = opendir(argv[1])) == NULL) {
-        perror("Erro ao abrir diretório");
+    int count;
+    char **files = list_images(input_dir, &count);
+    Histograms *hist = (Histograms *)calloc(1, sizeof(Histograms));
+    if (files == NULL || hist == NULL) {
         return 1;
     }
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) {
-            snprintf(path, sizeof(path), "%s/%s", argv[1], entry->d_name);
-            printf("Processando: %s\n", path);
-            process_image(path, rgb_stats, hsi_stats);
-        }
+    process_images(files, count, mask_dir, cache_path, num_threads, hist);
+
+    for (int i = 0; i < count; i++) free(files[i]);
+    free(files);
+
+    unsigned long long pixels = 0;
+    for (int k = 0; k < 256; k++) pixels += hist->rgb[0][k];
+    printf("\nPixels analisados: %llu\n", pixels);
+    if (pixels == 0) {
+        printf("Erro: nenhum pixel analisado\n");
+        free(hist);
+        return 1;
     }
-    closedir(dir);
 
     // Calcula thresholds
-    calculate_thresholds(rgb_stats, rgb_thresholds);
-    calculate_thresholds(hsi_stats, hsi_thresholds);
+    int ok = calculate_thresholds(hist, low, high, rgb_thresholds, hsi_thresholds);
+    free(hist);
+    if (!ok) {
+        printf("Erro: memória insuficiente\n");
+        return 1;
+    }
 
     // Exibe resultados
+    printf("\n(Min e Max nos percentis P%g e P%g)\n", low, high);
     printf("\n=== THRESHOLDS RGB ===\n");
     char *rgb_channels[] = {"Vermelho", "Verde", "Azul"};
     for (int i = 0; i < 3; i++) {
@@ -221,4 +873,5 @@ int main(int argc, char *argv[]) {
     save_thresholds_to_csv(rgb_thresholds, hsi_thresholds, output_dir);
 
     return 0;
-}
\ No newline at end of file
+}
+#endif // EXTRACAO_SEM_MAIN
@@ -0,0 +1,271 @@
+// =================================================================
+//      BIBLIOTECA DO DETECTOR DE FUMAÇA (IMPLEMENTAÇÃO)
+// =================================================================
+// Implementa a API de fumaca.h sobre as funções de detector_fumaca.c, que é
+// incluído sem o main (a linha de comando continua lá). Os quadros são
+// classificados em faixas de linhas no pool do contexto; os formatos RGB que
+// não são RGB24 são convertidos em blocos de PIXELS_POR_BLOCO pixels na pilha,
+// sem cópia do quadro inteiro, e o NV12 é classificado direto nos planos Y e UV.
+// Com DETECTOR_SEM_MAIN, as funções do detector e o stb ficam com ligação
+// interna: fumaca.o só exporta as funções fumaca_*.
+// =================================================================
+
+#define DETECTOR_SEM_MAIN
+#include "detector_fumaca.c"
+
+#include "fumaca.h"
+
+struct FumacaContexto {
+    FumacaConfig config;
+    LimiaresFumaca limiares;
+    TabelaFumaca tabela;
+    TabelaYuv tabela_yuv; // Construída na primeira detecção NV12
+    Classificador classificador;
+    PoolThreads *pool;
+    LimpezaMascara limpeza;
+    bool manter_mascara;
+    MascaraBits mascara;  // Reaproveitada enquanto as dimensões não mudarem
+    bool mascara_valida;  // A última detecção gerou 'mascara'
+};
+
+static pthread_once_t kernels_selecionados = PTHREAD_ONCE_INIT;
+
+static void selecionar_kernels_padrao(void) {
+    selecionar_kernels(NULL);
+}
+
+void fumaca_config_padrao(FumacaConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->limiar_percentual = 0.2f;
+    config->brilho_minimo = LIMIARES_PADRAO.brilho_minimo;
+    config->tolerancia_cinza = LIMIARES_PADRAO.tolerancia_cinza;
+    config->saturacao_maxima = LIMIARES_PADRAO.saturacao_maxima;
+    config->intensidade_minima = LIMIARES_PADRAO.intensidade_minima;
+}
+
+/**
+ * @brief Confere se os valores da configuração fazem sentido (os limiares são
+ * comparados com canais de 0 a 255; "< 256" ainda aceita qualquer valor).
+ */
+static bool config_valida(const FumacaConfig *c) {
+    return c->threads >= 0 && c->limiar_percentual >= 0.0f && c->limiar_percentual <= 100.0f &&
+           c->brilho_minimo >= 0 && c->brilho_minimo <= 255 &&
+           c->tolerancia_cinza >= 0 && c->tolerancia_cinza <= 256 &&
+           c->saturacao_maxima >= 0 && c->saturacao_maxima <= 256 &&
+           c->intensidade_minima >= 0 && c->intensidade_minima <= 255 &&
+           c->abertura_largura >= 0 && c->abertura_altura >= 0 &&
+           c->fechamento_largura >= 0 && c->fechamento_altura >= 0;
+}
+
+FumacaContexto *fumaca_criar(const FumacaConfig *config) {
+    FumacaConfig padrao;
+    fumaca_config_padrao(&padrao);
+    if (config && !config_valida(config)) return NULL;
+    pthread_once(&kernels_selecionados, selecionar_kernels_padrao);
+    FumacaContexto *ctx = (FumacaContexto *)calloc(1, sizeof(FumacaContexto));
+    if (!ctx) return NULL;
+    ctx->config = config ? *config : padrao;
+    FumacaConfig *c = &ctx->config;
+    ctx->limiares = (LimiaresFumaca){c->brilho_minimo, c->tolerancia_cinza, c->saturacao_maxima,
+                                     c->intensidade_minima};
+
+    if (c->caminho_tabela && !tabela_carregar_ou_construir(&ctx->tabela, c->caminho_tabela, &ctx->limiares)) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->classificador = (Classificador){&ctx->limiares, c->caminho_tabela ? &ctx->tabela : NULL};
+    // Um pool que não pôde ser criado (NULL) deixa o contexto em série, sem falhar
+    ctx->pool = pool_criar(c->threads > 0 ? c->threads : numero_processadores());
+    ctx->limpeza = (LimpezaMascara){c->abertura_largura, c->abertura_altura,
+                                    c->fechamento_largura, c->fechamento_altura};
+    ctx->manter_mascara = c->gerar_mascara || c->por_regioes || limpeza_ativa(&ctx->limpeza);
+    return ctx;
+}
+
+void fumaca_destruir(FumacaContexto *ctx) {
+    if (!ctx) return;
+    pool_destruir(ctx->pool);
+    mascara_bits_liberar(&ctx->mascara);
+    tabela_liberar(&ctx->tabela);
+    tabela_yuv_liberar(&ctx->tabela_yuv);
+    free(ctx);
+}
+
+// -----------------------------------------------------------------
+// Classificação de um quadro na memória do chamador
+// -----------------------------------------------------------------
+
+typedef struct {
+    const Classificador *classificador;
+    const uint8_t *pixels;
+    int largura, altura;
+    size_t stride;
+    FumacaFormato formato;
+    MascaraBits *mascara; // NULL: só conta
+    int linhas_faixa;
+    long *contagens;      // Uma posição por faixa
+} TrabalhoDeteccao;
+
+static int bytes_por_pixel(FumacaFormato formato) {
+    return formato == FUMACA_FORMATO_RGBA32 || formato == FUMACA_FORMATO_BGRA32 ? 4 : 3;
+}
+
+/**
+ * @brief Converte 'n' pixels do formato do chamador para RGB24.
+ */
+static void converter_para_rgb(const uint8_t *origem, FumacaFormato formato, int n, unsigned char *rgb) {
+    int passo = bytes_por_pixel(formato);
+    bool bgr = formato == FUMACA_FORMATO_BGR24 || formato == FUMACA_FORMATO_BGRA32;
+    for (int x = 0; x < n; ++x, origem += passo) {
+        rgb[3 * x] = origem[bgr ? 2 : 0];
+        rgb[3 * x + 1] = origem[1];
+        rgb[3 * x + 2] = origem[bgr ? 0 : 2];
+    }
+}
+
+static void tarefa_detectar_faixa(void *arg, int indice) {
+    TrabalhoDeteccao *t = (TrabalhoDeteccao *)arg;
+    int y0 = indice * t->linhas_faixa;
+    int y1 = y0 + t->linhas_faixa < t->altura ? y0 + t->linhas_faixa : t->altura;
+    int passo = bytes_por_pixel(t->formato);
+    unsigned char rgb[3 * PIXELS_POR_BLOCO];
+    long contagem = 0;
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t *linha = t->pixels + (size_t)y * t->stride;
+        if (t->formato == FUMACA_FORMATO_RGB24) { // Lido direto da memória do chamador
+            contagem += t->mascara
+                ? classificar_linha_bits(t->classificador, linha, 3, t->largura, mascara_bits_linha(t->mascara, y))
+                : classificar_linha(t->classificador, linha, 3, t->largura, NULL);
+            continue;
+        }
+        for (int x0 = 0; x0 < t->largura; x0 += PIXELS_POR_BLOCO) {
+            int n = t->largura - x0 < PIXELS_POR_BLOCO ? t->largura - x0 : PIXELS_POR_BLOCO;
+            converter_para_rgb(linha + (size_t)x0 * passo, t->formato, n, rgb);
+            // PIXELS_POR_BLOCO é múltiplo de 64: cada bloco começa numa palavra da máscara
+            contagem += t->mascara
+                ? classificar_linha_bits(t->classificador, rgb, 3, n, mascara_bits_linha(t->mascara, y) + x0 / 64)
+                : classificar_linha(t->classificador, rgb, 3, n, NULL);
+        }
+    }
+    t->contagens[indice] = contagem;
+}
+
+/**
+ * @brief Garante a máscara do contexto com as dimensões do quadro (se ela for mantida).
+ */
+static FumacaStatus preparar_mascara(FumacaContexto *ctx, int largura, int altura) {
+    ctx->mascara_valida = false;
+    if (ctx->manter_mascara && (ctx->mascara.width != largura || ctx->mascara.height != altura)) {
+        mascara_bits_liberar(&ctx->mascara);
+        ctx->mascara = mascara_bits_criar(largura, altura);
+        if (!ctx->mascara.palavras) return FUMACA_ERRO_MEMORIA;
+    }
+    return FUMACA_OK;
+}
+
+/**
+ * @brief Limpeza, regiões e veredito a partir da contagem da classificação.
+ * @return FUMACA_ERRO_MEMORIA se a limpeza ou a rotulagem não tiveram memória;
+ * nesse caso o resultado fica zerado e a máscara, inválida.
+ */
+static FumacaStatus concluir_deteccao(FumacaContexto *ctx, long contagem, int largura, int altura,
+                                      FumacaResultado *resultado) {
+    memset(resultado, 0, sizeof(*resultado));
+    if (limpeza_ativa(&ctx->limpeza)) {
+        if (!limpar_mascara_bits(&ctx->mascara, &ctx->limpeza)) return FUMACA_ERRO_MEMORIA;
+        contagem = contar_mascara_bits(&ctx->mascara);
+    }
+    long total = (long)largura * altura;
+    resultado->pixels_fumaca = contagem;
+    resultado->pixels_total = total;
+    resultado->percentual = 100.0f * contagem / total;
+    resultado->fumaca = resultado->percentual > ctx->config.limiar_percentual;
+    resultado->percentual_maior_regiao = -1.0f;
+    if (ctx->config.por_regioes) {
+        RegioesFumaca regioes = rotular_regioes(ctx->pool, &ctx->mascara);
+        if (regioes.falha) {
+            memset(resultado, 0, sizeof(*resultado));
+            return FUMACA_ERRO_MEMORIA;
+        }
+        long maior = regioes.quantidade > 0 ? regioes.regioes[0].area : 0;
+        resultado->regioes = regioes.quantidade;
+        resultado->percentual_maior_regiao = 100.0f * maior / total;
+        resultado->fumaca = resultado->percentual_maior_regiao > ctx->config.limiar_percentual;
+        regioes_liberar(&regioes);
+    }
+    ctx->mascara_valida = ctx->manter_mascara;
+    return FUMACA_OK;
+}
+
+FumacaStatus fumaca_detectar(FumacaContexto *ctx, const uint8_t *pixels, int largura, int altura,
+                             size_t stride, FumacaFormato formato, FumacaResultado *resultado) {
+    if (ctx && formato == FUMACA_FORMATO_NV12) {
+        return fumaca_detectar_nv12(ctx, pixels, stride, pixels ? pixels + stride * altura : NULL, stride,
+                                    largura, altura, resultado);
+    }
+    if (!ctx || !pixels || !resultado || largura <= 0 || altura <= 0 || formato < FUMACA_FORMATO_RGB24 ||
+        formato > FUMACA_FORMATO_BGRA32 || stride < (size_t)largura * bytes_por_pixel(formato)) {
+        return FUMACA_ERRO_ARGUMENTO;
+    }
+    FumacaStatus status = preparar_mascara(ctx, largura, altura);
+    if (status != FUMACA_OK) return status;
+
+    // As faixas são dimensionadas como as de classificar_imagem (entrada RGB de 3 canais)
+    Image dimensoes = {NULL, largura, altura, 3};
+    long contagens[MAX_FAIXAS];
+    TrabalhoDeteccao t = {&ctx->classificador, pixels, largura, altura, stride, formato,
+                          ctx->manter_mascara ? &ctx->mascara : NULL, linhas_por_faixa(&dimensoes), contagens};
+    int faixas = (altura + t.linhas_faixa - 1) / t.linhas_faixa;
+    pool_executar(ctx->pool, faixas, tarefa_detectar_faixa, &t);
+    long contagem = 0;
+    for (int i = 0; i < faixas; ++i) contagem += contagens[i];
+    return concluir_deteccao(ctx, contagem, largura, altura, resultado);
+}
+
+FumacaStatus fumaca_detectar_nv12(FumacaContexto *ctx, const uint8_t *plano_y, size_t stride_y,
+                                  const uint8_t *plano_uv, size_t stride_uv, int largura, int altura,
+                                  FumacaResultado *resultado) {
+    if (!ctx || !plano_y || !plano_uv || !resultado || largura <= 0 || altura <= 0 || stride_y < (size_t)largura ||
+        stride_uv < (size_t)((largura + 1) / 2) * 2) {
+        return FUMACA_ERRO_ARGUMENTO;
+    }
+    if (!ctx->tabela_yuv.bits && !tabela_yuv_construir(&ctx->tabela_yuv, &ctx->limiares)) {
+        tabela_yuv_liberar(&ctx->tabela_yuv);
+        return FUMACA_ERRO_MEMORIA;
+    }
+    FumacaStatus status = preparar_mascara(ctx, largura, altura);
+    if (status != FUMACA_OK) return status;
+    QuadroNv12 quadro = {plano_y, stride_y, plano_uv, stride_uv, largura, altura};
+    long contagem = classificar_nv12(ctx->pool, &ctx->tabela_yuv, &quadro, ctx->manter_mascara ? &ctx->mascara : NULL);
+    return concluir_deteccao(ctx, contagem, largura, altura, resultado);
+}
+
+// -----------------------------------------------------------------
+// Acesso à máscara final
+// -----------------------------------------------------------------
+
+FumacaStatus fumaca_copiar_mascara(const FumacaContexto *ctx, uint8_t *destino, size_t stride) {
+    if (!ctx || !destino) return FUMACA_ERRO_ARGUMENTO;
+    if (!ctx->mascara_valida) return FUMACA_ERRO_SEM_MASCARA;
+    if (stride < (size_t)ctx->mascara.width) return FUMACA_ERRO_ARGUMENTO;
+    for (int y = 0; y < ctx->mascara.height; ++y) {
+        expandir_mascara_linha(mascara_bits_linha(&ctx->mascara, y), ctx->mascara.width, destino + (size_t)y * stride);
+    }
+    return FUMACA_OK;
+}
+
+FumacaImagem fumaca_mascara_imagem(const FumacaContexto *ctx) {
+    FumacaImagem imagem = {NULL, 0, 0, 1};
+    if (!ctx || !ctx->mascara_valida) return imagem;
+    Image m = mascara_bits_para_image(&ctx->mascara);
+    imagem.data = m.data;
+    imagem.width = m.width;
+    imagem.height = m.height;
+    return imagem;
+}
+
+void fumaca_imagem_liberar(FumacaImagem *imagem) {
+    if (!imagem) return;
+    reserva_devolver(imagem->data);
+    imagem->data = NULL;
+}
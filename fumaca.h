@@ -0,0 +1,135 @@
+// =================================================================
+//      BIBLIOTECA DO DETECTOR DE FUMAÇA (API EMBUTÍVEL)
+// =================================================================
+// Expõe o detector de detector_fumaca.c para uso dentro de outro processo
+// (por exemplo, um software de gerenciamento de vídeo), sem passar imagens
+// por arquivos. O contexto guarda os limiares, os buffers de trabalho e o
+// pool de threads, e é reaproveitado a cada quadro. fumaca_detectar lê os
+// pixels direto da memória do chamador, sem copiá-los.
+//
+// Para compilar (no terminal):
+// gcc -O2 -c fumaca.c -o fumaca.o && ar rcs libfumaca.a fumaca.o
+// gcc -O2 -shared -fPIC -fvisibility=hidden fumaca.c -o libfumaca.so -lm -lpthread
+//
+// Um contexto não pode ser usado por duas threads ao mesmo tempo; use um
+// contexto por câmera (ou por thread).
+// =================================================================
+#ifndef FUMACA_H
+#define FUMACA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(FUMACA_DLL)
+#define FUMACA_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define FUMACA_API __attribute__((visibility("default")))
+#else
+#define FUMACA_API
+#endif
+
+typedef struct FumacaContexto FumacaContexto;
+
+// Disposição dos pixels na memória do chamador.
+typedef enum {
+    FUMACA_FORMATO_RGB24,   // R, G, B (lido sem conversão)
+    FUMACA_FORMATO_BGR24,   // B, G, R
+    FUMACA_FORMATO_RGBA32,  // R, G, B, A (alfa ignorado)
+    FUMACA_FORMATO_BGRA32,  // B, G, R, A (alfa ignorado)
+    FUMACA_FORMATO_NV12,    // Plano Y seguido do plano UV, ambos com o mesmo stride
+} FumacaFormato;
+
+typedef enum {
+    FUMACA_OK = 0,
+    FUMACA_ERRO_ARGUMENTO = -1, // Ponteiro nulo, dimensões ou stride inválidos
+    FUMACA_ERRO_MEMORIA = -2, // Sem memória para a máscara, a tabela, a limpeza ou as regiões
+    FUMACA_ERRO_SEM_MASCARA = -3, // A máscara pedida não foi gerada (veja FumacaConfig.gerar_mascara)
+} FumacaStatus;
+
+// Configuração do contexto. Comece de fumaca_config_padrao e altere só o que precisar:
+// os valores são usados como estão (um limiar 0 é um limiar 0).
+typedef struct {
+    int threads;                // Threads de classificação (0 = número de CPUs, 1 = sem pool)
+    float limiar_percentual;    // Alarme se a fumaça passar desta porcentagem, 0 a 100 (padrão: 0,2)
+    int brilho_minimo;          // Limiares das regras de cor, 0 a 255 (padrão: os do detector;
+                                // tolerancia_cinza e saturacao_maxima aceitam até 256)
+    int tolerancia_cinza;
+    int saturacao_maxima;
+    int intensidade_minima;
+    const char *caminho_tabela; // Classifica pela tabela RGB->fumaça de 2 MB (NULL = motor fundido)
+    int gerar_mascara;          // Mantém a máscara final para fumaca_copiar_mascara / fumaca_mascara_imagem
+    int por_regioes;            // Decide o alarme pela maior região conexa
+    int abertura_largura, abertura_altura;     // Limpeza morfológica da máscara (0 = desligada)
+    int fechamento_largura, fechamento_altura;
+} FumacaConfig;
+
+typedef struct {
+    int fumaca;                     // 1 se o alarme disparou
+    long pixels_fumaca;             // Depois da limpeza, se houver
+    long pixels_total;
+    float percentual;
+    float percentual_maior_regiao;  // Só com por_regioes (senão negativo)
+    int regioes;                    // Número de regiões conexas (só com por_regioes)
+} FumacaResultado;
+
+// Máscara 0/255 alocada pela biblioteca (variante que devolve uma imagem).
+typedef struct {
+    unsigned char *data;
+    int width;
+    int height;
+    int channels; // Sempre 1
+} FumacaImagem;
+
+/**
+ * @brief Preenche 'config' com os valores padrão do detector.
+ */
+FUMACA_API void fumaca_config_padrao(FumacaConfig *config);
+
+/**
+ * @brief Cria um contexto (NULL = configuração padrão).
+ * @return NULL se a configuração tiver valores fora das faixas, se a tabela não puder ser
+ * carregada ou construída, ou sem memória. Se o pool de threads não puder ser criado,
+ * o contexto é criado mesmo assim e classifica em série.
+ */
+FUMACA_API FumacaContexto *fumaca_criar(const FumacaConfig *config);
+
+FUMACA_API void fumaca_destruir(FumacaContexto *ctx);
+
+/**
+ * @brief Classifica uma imagem na memória do chamador.
+ * @param stride Bytes entre o início de duas linhas (pode ser maior que largura * bytes por pixel).
+ */
+FUMACA_API FumacaStatus fumaca_detectar(FumacaContexto *ctx, const uint8_t *pixels, int largura, int altura,
+                                        size_t stride, FumacaFormato formato, FumacaResultado *resultado);
+
+/**
+ * @brief Classifica um quadro NV12 com os planos Y e UV em posições quaisquer, sem
+ * convertê-lo para RGB. Na primeira chamada o contexto constrói a tabela YUV (2 MB).
+ */
+FUMACA_API FumacaStatus fumaca_detectar_nv12(FumacaContexto *ctx, const uint8_t *plano_y, size_t stride_y,
+                                             const uint8_t *plano_uv, size_t stride_uv, int largura, int altura,
+                                             FumacaResultado *resultado);
+
+/**
+ * @brief Copia a máscara final da última detecção (0/255, 1 byte por pixel) para 'destino'.
+ * Exige gerar_mascara (ou limpeza/regiões) na configuração.
+ */
+FUMACA_API FumacaStatus fumaca_copiar_mascara(const FumacaContexto *ctx, uint8_t *destino, size_t stride);
+
+/**
+ * @brief Como fumaca_copiar_mascara, mas devolve uma imagem nova (data == NULL em caso de erro).
+ * Libere com fumaca_imagem_liberar.
+ */
+FUMACA_API FumacaImagem fumaca_mascara_imagem(const FumacaContexto *ctx);
+
+FUMACA_API void fumaca_imagem_liberar(FumacaImagem *imagem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUMACA_H
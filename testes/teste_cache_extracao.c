@@ -0,0 +1,170 @@
+// =================================================================
+//      TESTE DO CACHE DA EXTRAÇÃO DE LIMIARES (--cache)
+// =================================================================
+// Copia algumas imagens do corpus de teste (e um arquivo que não decodifica)
+// para um diretório temporário e confere que os histogramas somados com o
+// cache são idênticos aos da análise sem cache: com o cache recém-criado,
+// reaproveitado, depois de uma imagem mudar e depois de o arquivo do cache
+// ser corrompido. Confere também a ida e volta do formato esparso dos parciais.
+//
+// Para compilar e executar (na raiz do projeto):
+// gcc -O2 testes/teste_cache_extracao.c -o teste_cache_extracao -lm -lpthread && ./teste_cache_extracao
+// =================================================================
+
+#define EXTRACAO_SEM_MAIN
+#include "../extracao-dados/extracao_dados.c"
+
+#define CORPUS "extracao-dados/teste_imagens/imagens_teste"
+
+static int falhas = 0;
+
+static void conferir(int condicao, const char *descricao) {
+    printf("%s: %s\n", condicao ? "ok" : "FALHA", descricao);
+    falhas += !condicao;
+}
+
+static int copiar_arquivo(const char *origem, const char *destino) {
+    FILE *in = fopen(origem, "rb"), *out = fopen(destino, "wb");
+    int ok = in && out;
+    char buf[65536];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) ok = fwrite(buf, 1, n, out) == n;
+    if (in) fclose(in);
+    if (out) ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Soma as imagens de 'dir' com ou sem cache e compara com 'esperado'
+static int histogramas_iguais(const char *dir, const char *cache_path, const Histograms *esperado) {
+    int count;
+    char **files = list_images(dir, &count);
+    Histograms *total = (Histograms *)calloc(1, sizeof(Histograms));
+    process_images(files, count, NULL, cache_path, 2, total);
+    int iguais = memcmp(total, esperado, sizeof(Histograms)) == 0;
+    for (int i = 0; i < count; i++) free(files[i]);
+    free(files);
+    free(total);
+    return iguais;
+}
+
+static void somar_sem_cache(const char *dir, Histograms *total) {
+    int count;
+    char **files = list_images(dir, &count);
+    memset(total, 0, sizeof(Histograms));
+    process_images(files, count, NULL, NULL, 2, total);
+    for (int i = 0; i < count; i++) free(files[i]);
+    free(files);
+}
+
+// Quantas entradas do cache em 'cache_path' são válidas e quantas são de arquivos que não decodificam
+static void contar_entradas(const char *cache_path, int *validas, int *falhas_decodificacao) {
+    StatsCache cache;
+    cache_load(&cache, cache_path);
+    *validas = *falhas_decodificacao = 0;
+    for (int i = 0; i < cache.count; i++) {
+        if (cache.entries[i].failed) (*falhas_decodificacao)++;
+        else (*validas)++;
+    }
+    cache_close(&cache);
+}
+
+/**
+ * @brief Codifica os histogramas de uma imagem e os soma de volta, inteiros e truncados.
+ */
+static void testar_parcial(const char *imagem) {
+    Histograms *hist = (Histograms *)calloc(1, sizeof(Histograms));
+    Histograms *copia = (Histograms *)malloc(sizeof(Histograms));
+    Histograms *zero = (Histograms *)calloc(1, sizeof(Histograms));
+    process_image(imagem, NULL, hist);
+    memcpy(copia, hist, sizeof(Histograms));
+
+    size_t size;
+    unsigned char *partial = encode_partial(hist, &size);
+    conferir(partial && memcmp(hist, zero, sizeof(Histograms)) == 0, "encode_partial zera os histogramas");
+    conferir(merge_partial(hist, partial, size) && memcmp(hist, copia, sizeof(Histograms)) == 0,
+             "merge_partial reconstrói os histogramas codificados");
+
+    memset(hist, 0, sizeof(Histograms));
+    int rejeitados = 1;
+    for (size_t corte = 0; corte < size; corte += 1 + size / 64) {
+        rejeitados = rejeitados && !merge_partial(hist, partial, corte);
+    }
+    conferir(rejeitados && memcmp(hist, zero, sizeof(Histograms)) == 0,
+             "merge_partial rejeita parciais truncados sem alterar os histogramas");
+
+    free(partial);
+    free(hist);
+    free(copia);
+    free(zero);
+}
+
+int main(void) {
+    char dir[] = "/tmp/teste_cache_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char cache_path[256], path[512], origem[512];
+    snprintf(cache_path, sizeof(cache_path), "%s.cache", dir);
+
+    // Algumas imagens do corpus e um arquivo que não é imagem
+    static const char *imagens[] = {"A0001.jpg", "A0002.jpg", "A0003.jpg", "A0004.jpg"};
+    for (size_t i = 0; i < sizeof(imagens) / sizeof(imagens[0]); i++) {
+        snprintf(origem, sizeof(origem), "%s/%s", CORPUS, imagens[i]);
+        snprintf(path, sizeof(path), "%s/%s", dir, imagens[i]);
+        if (!copiar_arquivo(origem, path)) {
+            printf("Erro: não foi possível copiar %s (rode o teste na raiz do projeto)\n", origem);
+            return 1;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/quebrada.jpg", dir);
+    FILE *f = fopen(path, "wb");
+    fputs("nao e uma imagem", f);
+    fclose(f);
+
+    Histograms *esperado = (Histograms *)malloc(sizeof(Histograms));
+    somar_sem_cache(dir, esperado);
+
+    int validas, quebradas;
+    conferir(histogramas_iguais(dir, cache_path, esperado), "cache recém-criado dá os mesmos histogramas");
+    contar_entradas(cache_path, &validas, &quebradas);
+    conferir(validas == 4 && quebradas == 1, "cache guarda as 4 imagens e o arquivo que não decodifica");
+    conferir(histogramas_iguais(dir, cache_path, esperado), "cache reaproveitado dá os mesmos histogramas");
+
+    // Uma imagem muda de conteúdo: só ela é reprocessada, e o total acompanha
+    snprintf(origem, sizeof(origem), "%s/A0005.jpg", CORPUS);
+    snprintf(path, sizeof(path), "%s/%s", dir, imagens[1]);
+    copiar_arquivo(origem, path);
+    somar_sem_cache(dir, esperado);
+    conferir(histogramas_iguais(dir, cache_path, esperado), "imagem alterada é reprocessada");
+
+    // Um byte trocado no meio do cache: a entrada atingida é reprocessada
+    struct stat st;
+    stat(cache_path, &st);
+    int fd = open(cache_path, O_RDWR);
+    unsigned char byte;
+    pread(fd, &byte, 1, st.st_size / 2);
+    byte ^= 0x5a;
+    pwrite(fd, &byte, 1, st.st_size / 2);
+    close(fd);
+    conferir(histogramas_iguais(dir, cache_path, esperado), "cache corrompido não altera os histogramas");
+    conferir(histogramas_iguais(dir, cache_path, esperado), "cache regravado depois da corrupção");
+
+    snprintf(path, sizeof(path), "%s/%s", dir, imagens[0]);
+    testar_parcial(path);
+
+    // Limpeza do diretório temporário
+    int count;
+    char **files = list_images(dir, &count);
+    for (int i = 0; i < count; i++) {
+        remove(files[i]);
+        free(files[i]);
+    }
+    free(files);
+    rmdir(dir);
+    remove(cache_path);
+    free(esperado);
+
+    printf("%s\n", falhas ? "FALHA" : "OK");
+    return falhas ? 1 : 0;
+}
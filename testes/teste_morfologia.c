@@ -0,0 +1,153 @@
+// =================================================================
+//      TESTE DA MORFOLOGIA (vHGW E MÁSCARAS DE BITS)
+// =================================================================
+// Compara morfologia_bytes (van Herk/Gil-Werman) e morfologia_bits (deslocamentos
+// com duplicação nas palavras de 64 pixels) com o mínimo/máximo direto sobre a
+// janela do elemento, pixel a pixel. A janela de x vai de x - L/2 a x - L/2 + L - 1
+// (idem na vertical); fora da imagem a erosão vê 255 e a dilatação vê 0.
+// As quatro operações são testadas com elementos pares, ímpares e de tamanho 1.
+//
+// Para compilar e executar (na raiz do projeto):
+// gcc -O2 testes/teste_morfologia.c -o teste_morfologia -lm -lpthread && ./teste_morfologia
+// =================================================================
+
+#define DETECTOR_SEM_MAIN
+#include "../detector_fumaca.c"
+
+// Gerador pseudoaleatório fixo, para que uma falha possa ser reproduzida
+static uint32_t semente = 2024;
+
+static uint32_t aleatorio(void) {
+    semente ^= semente << 13;
+    semente ^= semente >> 17;
+    semente ^= semente << 5;
+    return semente;
+}
+
+/**
+ * @brief Referência: erosão (mínimo) ou dilatação (máximo) direta, uma janela por pixel.
+ */
+static void extremo_direto(const unsigned char *entrada, unsigned char *saida, int w, int h, int largura_el,
+                           int altura_el, bool erosao) {
+    int ax = largura_el / 2, ay = altura_el / 2;
+    unsigned char fora = erosao ? 255 : 0;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            unsigned char v = fora;
+            for (int j = y - ay; j < y - ay + altura_el; ++j) {
+                for (int i = x - ax; i < x - ax + largura_el; ++i) {
+                    unsigned char p = (i < 0 || j < 0 || i >= w || j >= h) ? fora : entrada[(size_t)j * w + i];
+                    if (erosao ? p < v : p > v) v = p;
+                }
+            }
+            saida[(size_t)y * w + x] = v;
+        }
+    }
+}
+
+static void morfologia_direta(unsigned char *dados, int w, int h, OperacaoMorfologica op, int largura_el,
+                              int altura_el) {
+    unsigned char *tmp = (unsigned char *)malloc((size_t)w * h);
+    if (op == MORF_EROSAO || op == MORF_ABERTURA) {
+        extremo_direto(dados, tmp, w, h, largura_el, altura_el, true);
+        memcpy(dados, tmp, (size_t)w * h);
+    }
+    if (op != MORF_EROSAO) {
+        extremo_direto(dados, tmp, w, h, largura_el, altura_el, false);
+        memcpy(dados, tmp, (size_t)w * h);
+    }
+    if (op == MORF_FECHAMENTO) {
+        extremo_direto(dados, tmp, w, h, largura_el, altura_el, true);
+        memcpy(dados, tmp, (size_t)w * h);
+    }
+    free(tmp);
+}
+
+/**
+ * @brief Aplica 'op' a uma máscara aleatória pelos três caminhos e compara.
+ * @param binaria Máscara 0/255 (senão, tons arbitrários, só para o caminho de bytes).
+ * @return true se os resultados coincidem com a referência.
+ */
+static bool testar_operacao(int w, int h, OperacaoMorfologica op, int largura_el, int altura_el, bool binaria) {
+    static const char *nomes[] = {"erosao", "dilatacao", "abertura", "fechamento"};
+    size_t n = (size_t)w * h;
+    int densidade = (int)(aleatorio() % 1000);
+    unsigned char *original = (unsigned char *)malloc(n);
+    for (size_t i = 0; i < n; ++i) {
+        original[i] = binaria ? ((int)(aleatorio() % 1000) < densidade ? 255 : 0) : (unsigned char)aleatorio();
+    }
+
+    unsigned char *esperado = (unsigned char *)malloc(n);
+    memcpy(esperado, original, n);
+    morfologia_direta(esperado, w, h, op, largura_el, altura_el);
+
+    Image bytes = {(unsigned char *)malloc(n), w, h, 1};
+    memcpy(bytes.data, original, n);
+    morfologia_bytes(&bytes, op, largura_el, altura_el);
+    bool ok_bytes = memcmp(bytes.data, esperado, n) == 0;
+
+    bool ok_bits = true;
+    if (binaria) {
+        MascaraBits bits = mascara_bits_criar(w, h);
+        for (int y = 0; y < h; ++y) {
+            empacotar_mascara_linha(original + (size_t)y * w, w, bits.palavras + (size_t)y * bits.palavras_por_linha);
+        }
+        morfologia_bits(&bits, op, largura_el, altura_el);
+        Image expandida = mascara_bits_para_image(&bits);
+        ok_bits = memcmp(expandida.data, esperado, n) == 0;
+        reserva_devolver(expandida.data);
+        mascara_bits_liberar(&bits);
+    }
+
+    if (!ok_bytes || !ok_bits) {
+        printf("FALHA: %s %dx%d em %dx%d (%s)%s%s\n", nomes[op], largura_el, altura_el, w, h,
+               binaria ? "0/255" : "tons", ok_bytes ? "" : " [bytes]", ok_bits ? "" : " [bits]");
+    }
+    free(original);
+    free(esperado);
+    free(bytes.data);
+    return ok_bytes && ok_bits;
+}
+
+int main(void) {
+    // Larguras em torno dos limites de palavra (64 bits) e do bloco SSE2 (16 bytes);
+    // elementos maiores que a própria imagem também entram
+    static const int larguras[] = {1, 13, 63, 64, 65, 150};
+    static const int alturas[] = {1, 2, 17, 70};
+    static const int elementos[] = {1, 2, 3, 4, 5, 8, 15, 66, 80};
+    static const OperacaoMorfologica ops[] = {MORF_EROSAO, MORF_DILATACAO, MORF_ABERTURA, MORF_FECHAMENTO};
+
+    int testes = 0, falhas = 0;
+    for (size_t a = 0; a < sizeof(larguras) / sizeof(larguras[0]); ++a) {
+        for (size_t b = 0; b < sizeof(alturas) / sizeof(alturas[0]); ++b) {
+            for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o) {
+                for (size_t e = 0; e < sizeof(elementos) / sizeof(elementos[0]); ++e) {
+                    // Elemento quadrado, só horizontal e só vertical
+                    int el = elementos[e], outro = elementos[(e * 7 + 3) % (sizeof(elementos) / sizeof(elementos[0]))];
+                    int formas[3][2] = {{el, outro}, {el, 1}, {1, el}};
+                    for (int f = 0; f < 3; ++f) {
+                        for (int binaria = 0; binaria <= 1; ++binaria) {
+                            testes++;
+                            falhas += !testar_operacao(larguras[a], alturas[b], ops[o], formas[f][0], formas[f][1],
+                                                       binaria);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Imagens altas: a passada vertical percorre mais de uma faixa de colunas
+    // (BYTES_TEMPORARIOS_MORFOLOGIA), nas máscaras de bytes e nas de bits
+    static const int altos[][4] = {{2200, 2100, 3, 5}, {1030, 1300, 2, 4}, {700, 2100, 1, 9}};
+    for (size_t a = 0; a < sizeof(altos) / sizeof(altos[0]); ++a) {
+        for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o) {
+            testes++;
+            falhas += !testar_operacao(altos[a][0], altos[a][1], ops[o], altos[a][2], altos[a][3], true);
+        }
+    }
+
+    printf("%s: %d de %d operações coincidem com o mínimo/máximo direto\n", falhas ? "FALHA" : "OK",
+           testes - falhas, testes);
+    return falhas ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// =================================================================
+//      TESTE DA ROTULAGEM DE REGIÕES CONEXAS
+// =================================================================
+// Compara rotular_regioes (union-find sobre as corridas da máscara de bits,
+// em faixas paralelas) com uma busca em largura simples, pixel a pixel,
+// em vizinhança-8, sobre máscaras aleatórias de vários tamanhos e densidades.
+// As duas devem achar as mesmas regiões, com a mesma área, caixa e centroide.
+//
+// Para compilar e executar (na raiz do projeto):
+// gcc -O2 testes/teste_regioes.c -o teste_regioes -lm -lpthread && ./teste_regioes
+// =================================================================
+
+#define DETECTOR_SEM_MAIN
+#include "../detector_fumaca.c"
+
+// Gerador pseudoaleatório fixo, para que uma falha possa ser reproduzida
+static uint32_t semente = 12345;
+
+static uint32_t aleatorio(void) {
+    semente ^= semente << 13;
+    semente ^= semente >> 17;
+    semente ^= semente << 5;
+    return semente;
+}
+
+/**
+ * @brief Máscara 0/255 com ruído de densidade 'densidade' (0-1000 por mil) e
+ * alguns retângulos cheios, para ter regiões grandes e pixels soltos.
+ */
+static unsigned char *gerar_mascara(int w, int h, int densidade) {
+    unsigned char *m = (unsigned char *)calloc((size_t)w * h, 1);
+    for (size_t i = 0; i < (size_t)w * h; ++i) m[i] = (int)(aleatorio() % 1000) < densidade ? 255 : 0;
+    int retangulos = (int)(aleatorio() % 6);
+    for (int r = 0; r < retangulos; ++r) {
+        int x0 = (int)(aleatorio() % w), y0 = (int)(aleatorio() % h);
+        int x1 = x0 + (int)(aleatorio() % (w / 3 + 1)), y1 = y0 + (int)(aleatorio() % (h / 3 + 1));
+        for (int y = y0; y <= y1 && y < h; ++y) {
+            for (int x = x0; x <= x1 && x < w; ++x) m[(size_t)y * w + x] = 255;
+        }
+    }
+    return m;
+}
+
+/**
+ * @brief Referência: busca em largura em vizinhança-8 sobre a máscara de bytes.
+ */
+static RegiaoFumaca *regioes_por_busca(const unsigned char *m, int w, int h, int *quantidade) {
+    int *fila = (int *)malloc(sizeof(int) * (size_t)w * h);
+    unsigned char *visitado = (unsigned char *)calloc((size_t)w * h, 1);
+    int capacidade = 64;
+    RegiaoFumaca *regioes = (RegiaoFumaca *)malloc(sizeof(RegiaoFumaca) * capacidade);
+    *quantidade = 0;
+    for (int inicio = 0; inicio < w * h; ++inicio) {
+        if (!m[inicio] || visitado[inicio]) continue;
+        long area = 0;
+        double soma_x = 0, soma_y = 0;
+        int x_min = w, y_min = h, x_max = -1, y_max = -1;
+        int cabeca = 0, cauda = 0;
+        fila[cauda++] = inicio;
+        visitado[inicio] = 1;
+        while (cabeca < cauda) {
+            int p = fila[cabeca++], x = p % w, y = p / w;
+            area++;
+            soma_x += x;
+            soma_y += y;
+            if (x < x_min) x_min = x;
+            if (x > x_max) x_max = x;
+            if (y < y_min) y_min = y;
+            if (y > y_max) y_max = y;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = x + dx, ny = y + dy;
+                    if (nx < 0 || ny < 0 || nx >= w || ny >= h) continue;
+                    int q = ny * w + nx;
+                    if (m[q] && !visitado[q]) {
+                        visitado[q] = 1;
+                        fila[cauda++] = q;
+                    }
+                }
+            }
+        }
+        if (*quantidade == capacidade) {
+            capacidade *= 2;
+            regioes = (RegiaoFumaca *)realloc(regioes, sizeof(RegiaoFumaca) * capacidade);
+        }
+        regioes[(*quantidade)++] = (RegiaoFumaca){area, x_min, y_min, x_max, y_max,
+                                                  (float)(soma_x / area), (float)(soma_y / area)};
+    }
+    free(fila);
+    free(visitado);
+    return regioes;
+}
+
+// Ordem total (área, depois caixa), para comparar regiões de mesma área
+static int ordem_total_regioes(const void *a, const void *b) {
+    const RegiaoFumaca *ra = (const RegiaoFumaca *)a, *rb = (const RegiaoFumaca *)b;
+    if (ra->area != rb->area) return ra->area > rb->area ? -1 : 1;
+    if (ra->y_min != rb->y_min) return ra->y_min - rb->y_min;
+    if (ra->x_min != rb->x_min) return ra->x_min - rb->x_min;
+    if (ra->y_max != rb->y_max) return ra->y_max - rb->y_max;
+    return ra->x_max - rb->x_max;
+}
+
+/**
+ * @brief Rotula uma máscara pelos dois métodos e compara.
+ * @return true se as regiões coincidem.
+ */
+static bool testar_mascara(PoolThreads *pool, int w, int h, int densidade) {
+    unsigned char *bytes = gerar_mascara(w, h, densidade);
+    MascaraBits bits = mascara_bits_criar(w, h);
+    for (int y = 0; y < h; ++y) {
+        empacotar_mascara_linha(bytes + (size_t)y * w, w, bits.palavras + (size_t)y * bits.palavras_por_linha);
+    }
+
+    RegioesFumaca obtidas = rotular_regioes(pool, &bits);
+    int esperadas_qtd;
+    RegiaoFumaca *esperadas = regioes_por_busca(bytes, w, h, &esperadas_qtd);
+    qsort(obtidas.regioes, obtidas.quantidade, sizeof(RegiaoFumaca), ordem_total_regioes);
+    qsort(esperadas, esperadas_qtd, sizeof(RegiaoFumaca), ordem_total_regioes);
+
+    bool ok = obtidas.quantidade == esperadas_qtd;
+    for (int i = 0; ok && i < esperadas_qtd; ++i) {
+        const RegiaoFumaca *a = &obtidas.regioes[i], *e = &esperadas[i];
+        ok = a->area == e->area && a->x_min == e->x_min && a->y_min == e->y_min && a->x_max == e->x_max &&
+             a->y_max == e->y_max && fabsf(a->centroide_x - e->centroide_x) < 1e-2f &&
+             fabsf(a->centroide_y - e->centroide_y) < 1e-2f;
+    }
+    if (!ok) {
+        printf("FALHA: %dx%d, densidade %d/1000: %d regiões (esperadas %d)\n", w, h, densidade,
+               obtidas.quantidade, esperadas_qtd);
+    }
+
+    regioes_liberar(&obtidas);
+    free(esperadas);
+    mascara_bits_liberar(&bits);
+    free(bytes);
+    return ok;
+}
+
+int main(void) {
+    // Larguras em torno dos limites de palavra (64 bits) e alturas que cruzam
+    // várias faixas de LINHAS_POR_FAIXA_REGIOES linhas
+    static const int larguras[] = {1, 7, 63, 64, 65, 130, 257};
+    static const int alturas[] = {1, 5, 63, 200, 517};
+    static const int densidades[] = {0, 20, 300, 550, 1000};
+    PoolThreads *pool = pool_criar(4);
+
+    int testes = 0, falhas = 0;
+    for (size_t a = 0; a < sizeof(larguras) / sizeof(larguras[0]); ++a) {
+        for (size_t b = 0; b < sizeof(alturas) / sizeof(alturas[0]); ++b) {
+            for (size_t c = 0; c < sizeof(densidades) / sizeof(densidades[0]); ++c) {
+                testes++;
+                falhas += !testar_mascara(pool, larguras[a], alturas[b], densidades[c]);
+                testes++;
+                falhas += !testar_mascara(NULL, larguras[a], alturas[b], densidades[c]);
+            }
+        }
+    }
+
+    pool_destruir(pool);
+    printf("%s: %d de %d máscaras coincidem com a busca em largura\n", falhas ? "FALHA" : "OK", testes - falhas,
+           testes);
+    return falhas ? 1 : 0;
+}